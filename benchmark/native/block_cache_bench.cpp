@@ -0,0 +1,258 @@
+// BlockCache micro-benchmarks.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++17 -pthread -Imacos/Classes -o /tmp/block_cache_bench
+//       benchmark/native/block_cache_bench.cpp macos/Classes/block_cache.cpp
+//       macos/Classes/eviction_policy.cpp macos/Classes/slab_arena.cpp
+//       macos/Classes/disk_cache.cpp macos/Classes/compressed_pool.cpp
+//       macos/Classes/lz_codec.cpp macos/Classes/dedup_store.cpp
+//   /tmp/block_cache_bench capacity [MB...]   put/read latency vs capacity
+//   /tmp/block_cache_bench threads [N...]     read throughput vs reader threads
+//   /tmp/block_cache_bench threads-dedup [N...]
+//                                             the same with dedup on and N
+//                                             publisher threads
+//   /tmp/block_cache_bench disk [MB]          warm-start reads from the disk tier
+//                                             (uses $TMPDIR/block_cache_bench_l2)
+//   /tmp/block_cache_bench compressed [MB]    hit ratio with and without the
+//                                             compressed pool
+//
+// Each run happens in a forked child because BlockCache is a process-wide
+// singleton.
+
+#include "block_cache.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static double now_ns() {
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void run_forked(const std::function<void()>& fn) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        fn();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+}
+
+// The cache is filled first, so every measured put evicts.
+static void run_capacity(size_t capacity_mb) {
+    BlockCache& cache = BlockCache::instance();
+    double t_init = now_ns();
+    cache.init(capacity_mb);
+    double init_us = (now_ns() - t_init) / 1000;
+
+    const uint64_t slots = capacity_mb * 1024 * 1024 / BLOCK_SIZE;
+    const uint64_t file_id = BlockCache::make_file_id(1, 42);
+    std::vector<uint8_t> block(BLOCK_SIZE, 0xAB);
+    std::vector<uint8_t> out(4096);
+
+    for (uint64_t b = 0; b < slots; ++b) {
+        cache.put_block(file_id, b, block.data(), block.size());
+    }
+
+    const int ops = 20000;
+    uint64_t next = slots;
+    double t0 = now_ns();
+    for (int i = 0; i < ops; ++i) {
+        cache.put_block(file_id, next++, block.data(), block.size());
+    }
+    double put_ns = (now_ns() - t0) / ops;
+
+    // Reads hit the most recent `slots` blocks, at random 4KB offsets
+    std::mt19937_64 rng(7);
+    std::uniform_int_distribution<uint64_t> pick(next - slots, next - 1);
+    t0 = now_ns();
+    for (int i = 0; i < ops; ++i) {
+        uint64_t offset = pick(rng) * BLOCK_SIZE + (rng() % 32) * 4096;
+        cache.read(file_id, offset, out.size(), out.data());
+    }
+    double read_ns = (now_ns() - t0) / ops;
+
+    printf("%8zu MB %8llu slots   init %8.0f us   put %9.0f ns   read(4KB) %7.0f ns\n",
+           capacity_mb, (unsigned long long)slots, init_us, put_ns, read_ns);
+    fflush(stdout);
+}
+
+// N reader threads issue random 4KB reads over a resident working set while
+// one prefetcher thread keeps inserting new blocks, for a fixed duration.
+// With dedup, N prefetchers scan a range twice the cache, so every put
+// publishes, with blocks of a few distinct contents that are shared already.
+static void run_threads(int readers, bool dedup) {
+    const size_t capacity_mb = 256;
+    BlockCache& cache = BlockCache::instance();
+    cache.enable_dedup(dedup);
+    cache.init(capacity_mb);
+
+    const uint64_t slots = capacity_mb * 1024 * 1024 / BLOCK_SIZE;
+    const uint64_t working_set = slots / 2;
+    const uint64_t hot_file = BlockCache::make_file_id(1, 1);
+    const uint64_t scan_file = BlockCache::make_file_id(1, 2);
+    std::vector<std::vector<uint8_t>> contents;
+    for (int i = 0; i < (dedup ? 16 : 1); ++i) contents.emplace_back(BLOCK_SIZE, (uint8_t)(0x5A + i));
+    for (uint64_t b = 0; b < working_set; ++b) {
+        const auto& block = contents[b % contents.size()];
+        cache.put_block(hot_file, b, block.data(), block.size());
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> total_reads{0};
+    std::atomic<uint64_t> total_puts{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < readers; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            std::vector<uint8_t> out(4096);
+            uint64_t n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                uint64_t offset = (rng() % working_set) * BLOCK_SIZE + (rng() % 32) * 4096;
+                cache.read(hot_file, offset, out.size(), out.data());
+                ++n;
+            }
+            total_reads += n;
+        });
+    }
+    const int prefetchers = dedup ? readers : 1;
+    const uint64_t scan_range = dedup ? slots * 2 : slots / 4;
+    for (int t = 0; t < prefetchers; ++t) {
+        threads.emplace_back([&, t] {
+            uint64_t n = 0;
+            for (uint64_t b = t; !stop.load(std::memory_order_relaxed); b += prefetchers) {
+                const auto& block = contents[b % contents.size()];
+                cache.put_block(scan_file, b % scan_range, block.data(), block.size());
+                ++n;
+            }
+            total_puts += n;
+        });
+    }
+
+    const double seconds = 1.0;
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& th : threads) th.join();
+
+    printf("%3d readers %3d prefetchers   %10.0f reads/s   %9.0f puts/s\n", readers, prefetchers,
+           total_reads.load() / seconds, total_puts.load() / seconds);
+    fflush(stdout);
+}
+
+// One process writes MB of blocks through to the disk tier; a second, with
+// a cold RAM cache as after an app restart, reads them back.
+static void run_disk(size_t image_mb) {
+    const char* tmp = getenv("TMPDIR");
+    std::string dir = std::string(tmp ? tmp : "/tmp") + "/block_cache_bench_l2";
+    const uint64_t file_id = BlockCache::make_file_id(1, 4242);
+    const uint64_t blocks = image_mb * 1024 * 1024 / BLOCK_SIZE;
+    const uint64_t change = BlockCache::make_change_attr(blocks * BLOCK_SIZE, 1700000000, 0);
+    auto open_cache = [&] {
+        BlockCache& cache = BlockCache::instance();
+        cache.init(image_mb + 64);
+        cache.enable_disk_cache(dir, image_mb + 64);
+        cache.set_file_size(file_id, blocks * BLOCK_SIZE);
+        cache.set_file_change(file_id, change);
+        return &cache;
+    };
+
+    run_forked([&] {
+        BlockCache* cache = open_cache();
+        std::vector<uint8_t> block(BLOCK_SIZE, 0x3C);
+        double t0 = now_ns();
+        for (uint64_t b = 0; b < blocks; ++b) {
+            cache->put_block(file_id, b, block.data(), block.size());
+        }
+        double secs = (now_ns() - t0) / 1e9;
+        printf("write-through %5zu MB   %8.0f MB/s\n", image_mb, image_mb / secs);
+        fflush(stdout);
+    });
+
+    run_forked([&] {
+        BlockCache* cache = open_cache();
+        std::vector<uint8_t> out(BLOCK_SIZE);
+        uint64_t served = 0;
+        double t0 = now_ns();
+        for (uint64_t b = 0; b < blocks; ++b) {
+            if (cache->read(file_id, b * BLOCK_SIZE, BLOCK_SIZE, out.data()) > 0) served++;
+        }
+        double secs = (now_ns() - t0) / 1e9;
+        printf("warm start    %5zu MB   %8.0f MB/s   %llu/%llu blocks from disk\n", image_mb,
+               image_mb / secs, (unsigned long long)served, (unsigned long long)blocks);
+        fflush(stdout);
+    });
+}
+
+// Skewed random reads over a working set twice the cache, first without
+// and then with a compressed pool of half the cache size. Blocks are
+// half zero padding, roughly like a disc image's sectors.
+static void run_compressed(size_t capacity_mb, size_t pool_mb) {
+    BlockCache& cache = BlockCache::instance();
+    cache.enable_compressed_cache(pool_mb);
+    cache.init(capacity_mb);
+    const uint64_t file_id = BlockCache::make_file_id(1, 77);
+    const uint64_t universe = capacity_mb * 1024 * 1024 / BLOCK_SIZE * 2;
+
+    std::vector<uint8_t> block(BLOCK_SIZE);
+    std::mt19937_64 fill_rng(5);
+    for (size_t i = 0; i < BLOCK_SIZE / 2; ++i) block[i] = (uint8_t)(fill_rng() % 64);
+    std::vector<uint8_t> out(BLOCK_SIZE);
+
+    // Zipf-like: squaring a uniform draw skews towards low block ids
+    std::mt19937_64 rng(6);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    const size_t accesses = universe * 20;
+    double t0 = now_ns();
+    for (size_t i = 0; i < accesses; ++i) {
+        double u = uniform(rng);
+        uint64_t b = (uint64_t)(u * u * universe);
+        if (cache.read(file_id, b * BLOCK_SIZE, 4096, out.data()) < 0) {
+            cache.put_block(file_id, b, block.data(), block.size());
+        }
+    }
+    double secs = (now_ns() - t0) / 1e9;
+
+    BlockCacheStats s = cache.stats();
+    uint64_t lookups = s.hits + s.misses;
+    printf("pool %4zu MB   hit ratio %6.2f%%   gain %6.2f%%   ratio %5.2f   "
+           "decompress %6.1f us   pool %5.1f MB   %6.0f reads/s\n",
+           pool_mb, 100.0 * s.hits / lookups, 100.0 * s.compressed_hits / lookups,
+           s.compressed_stored_bytes ? (double)s.compressed_raw_bytes / s.compressed_stored_bytes : 0.0,
+           s.compressed_hits ? s.decompress_ns / 1000.0 / s.compressed_hits : 0.0,
+           s.compressed_resident_bytes / (1024.0 * 1024.0), accesses / secs);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    const char* mode = argc > 1 ? argv[1] : "capacity";
+    std::vector<size_t> args;
+    for (int i = 2; i < argc; ++i) args.push_back(strtoul(argv[i], nullptr, 10));
+
+    if (strcmp(mode, "compressed") == 0) {
+        size_t mb = args.empty() ? 64 : args[0];
+        run_forked([mb] { run_compressed(mb, 0); });
+        run_forked([mb] { run_compressed(mb, mb / 2); });
+    } else if (strcmp(mode, "disk") == 0) {
+        run_disk(args.empty() ? 256 : args[0]);
+    } else if (strcmp(mode, "threads") == 0 || strcmp(mode, "threads-dedup") == 0) {
+        bool dedup = strcmp(mode, "threads-dedup") == 0;
+        if (args.empty()) args = {1, 2, 4, 8};
+        printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+        for (size_t n : args) run_forked([n, dedup] { run_threads((int)n, dedup); });
+    } else {
+        if (args.empty()) args = {64, 128, 256, 512, 1024, 2048};
+        for (size_t mb : args) run_forked([mb] { run_capacity(mb); });
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Synthetic memory-pressure driver for BlockCache::trim (Linux only).
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++17 -pthread -Imacos/Classes -o /tmp/cache_pressure_driver
+//       benchmark/native/cache_pressure_driver.cpp macos/Classes/block_cache.cpp
+//       macos/Classes/eviction_policy.cpp macos/Classes/slab_arena.cpp
+//       macos/Classes/disk_cache.cpp macos/Classes/compressed_pool.cpp
+//       macos/Classes/lz_codec.cpp macos/Classes/dedup_store.cpp
+//   /tmp/cache_pressure_driver [capacity_mb]
+//
+// Fills the cache, then grows a balloon allocation in steps against a budget
+// of twice the cache size, raising the trim level as the balloon fills the
+// budget, the way an app reacts to escalating low-memory signals. After each
+// trim the process RSS must drop by about what trim reported. Finally the
+// balloon is freed and the cache must refill to capacity. Exits non-zero on
+// a mismatch.
+
+#include "block_cache.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+static size_t rss_bytes() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long size = 0, resident = 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static double mb(size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+static void fill(BlockCache& cache, uint64_t file_id, uint64_t first, uint64_t count) {
+    std::vector<uint8_t> block(BLOCK_SIZE, 0xC3);
+    for (uint64_t b = first; b < first + count; ++b) {
+        cache.put_block(file_id, b, block.data(), block.size());
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t capacity_mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 256;
+    if (capacity_mb == 0) capacity_mb = 256;
+    const size_t capacity = capacity_mb * 1024 * 1024;
+    const uint64_t slots = capacity / BLOCK_SIZE;
+    const uint64_t file_id = BlockCache::make_file_id(1, 7);
+
+    BlockCache& cache = BlockCache::instance();
+    cache.init(capacity_mb);
+    fill(cache, file_id, 0, slots);
+    printf("filled: rss %.0f MB, resident %.0f MB\n",
+           mb(rss_bytes()), mb(cache.stats().resident_bytes));
+
+    const size_t budget = 2 * capacity;
+    const size_t step = capacity / 4;
+    std::vector<char*> balloon;
+    int level = -1;
+    int failures = 0;
+    printf("%10s %6s %10s %10s %10s %10s\n",
+           "balloon", "level", "freed", "rss drop", "rss", "resident");
+    for (size_t used = step; used <= budget; used += step) {
+        char* chunk = static_cast<char*>(malloc(step));
+        memset(chunk, 1, step);
+        balloon.push_back(chunk);
+
+        int wanted = used * 4 < budget * 2 ? kTrimFreeSlots
+                   : used * 4 < budget * 3 ? kTrimModerate
+                   : used < budget ? kTrimLow : kTrimComplete;
+        if (wanted <= level) continue;
+        level = wanted;
+
+        size_t before = rss_bytes();
+        size_t freed = cache.trim(static_cast<CacheTrimLevel>(level));
+        size_t after = rss_bytes();
+        size_t drop = before > after ? before - after : 0;
+        printf("%7.0f MB %6d %7.0f MB %7.0f MB %7.0f MB %7.0f MB\n", mb(used), level,
+               mb(freed), mb(drop), mb(after), mb(cache.stats().resident_bytes));
+        // Allow for allocator and page-table noise of a few MB
+        if (drop + 4 * 1024 * 1024 < freed || drop > freed + 4 * 1024 * 1024) {
+            printf("  mismatch: trim reported %.1f MB, RSS dropped %.1f MB\n", mb(freed), mb(drop));
+            failures++;
+        }
+    }
+
+    for (char* chunk : balloon) free(chunk);
+    fill(cache, file_id, slots, slots);
+    size_t resident = cache.stats().resident_bytes;
+    printf("refilled: rss %.0f MB, resident %.0f MB, trimmed in total %.0f MB\n",
+           mb(rss_bytes()), mb(resident), mb(cache.stats().trimmed_bytes));
+    if (resident != capacity) {
+        printf("  cache did not refill to capacity\n");
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+// Trace-driven hit ratio comparison of the BlockCache eviction policies.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++17 -pthread -Imacos/Classes -o /tmp/eviction_trace_bench
+//       benchmark/native/eviction_trace_bench.cpp macos/Classes/block_cache.cpp
+//       macos/Classes/eviction_policy.cpp macos/Classes/slab_arena.cpp
+//       macos/Classes/disk_cache.cpp macos/Classes/compressed_pool.cpp
+//       macos/Classes/lz_codec.cpp macos/Classes/dedup_store.cpp
+//   /tmp/eviction_trace_bench [capacity_mb]            built-in synthetic traces
+//   /tmp/eviction_trace_bench [capacity_mb] FILE...    replay recorded traces
+//
+// A trace file holds one access per line: "<file_id> <block_id>". Every access
+// is a read() of the block; misses are filled with put_block, as the VFS does
+// after fetching. Each (trace, policy) pair runs in a forked child because
+// BlockCache is a process-wide singleton.
+
+#include "block_cache.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct Access {
+    uint64_t file_id;
+    uint64_t block_id;
+};
+
+struct Trace {
+    std::string name;
+    std::vector<Access> accesses;
+};
+
+static void run_forked(const std::function<void()>& fn) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        fn();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+}
+
+// Samples ranks 0..n-1 with P(k) ~ 1 / (k + 1)^s
+class Zipf {
+public:
+    Zipf(size_t n, double s) : cdf_(n) {
+        double sum = 0;
+        for (size_t k = 0; k < n; ++k) cdf_[k] = (sum += 1.0 / std::pow(k + 1.0, s));
+        for (double& c : cdf_) c /= sum;
+    }
+    template <typename Rng> size_t operator()(Rng& rng) {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        return std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+// An emulator streaming a 4GB disc image front to back while it keeps
+// revisiting a small hot set (header, TOC, code region) of the same image.
+static Trace scan_with_hot_set(size_t slots) {
+    Trace t{"scan+hot", {}};
+    const uint64_t image = BlockCache::make_file_id(1, 1);
+    const uint64_t image_blocks = 4ULL * 1024 * 1024 * 1024 / BLOCK_SIZE;
+    const uint64_t hot_base = image_blocks - slots; // code region near the end
+    const size_t hot = slots / 3;
+    std::mt19937_64 rng(1);
+    Zipf zipf(hot, 0.8);
+    for (uint64_t b = 0; b < image_blocks; ++b) {
+        t.accesses.push_back({image, b});
+        for (int i = 0; i < 2; ++i) {
+            size_t k = zipf(rng);
+            t.accesses.push_back({image, k < 16 ? k : hot_base + k});
+        }
+    }
+    return t;
+}
+
+// Skewed random access over many files' blocks, working set 8x the cache
+static Trace zipf_trace(size_t slots) {
+    Trace t{"zipf-0.9", {}};
+    const size_t universe = slots * 8;
+    std::mt19937_64 rng(2);
+    Zipf zipf(universe, 0.9);
+    for (size_t i = 0; i < universe * 20; ++i) {
+        size_t k = zipf(rng);
+        t.accesses.push_back({BlockCache::make_file_id(1, 100 + k % 7), k});
+    }
+    return t;
+}
+
+// A loop slightly larger than the cache: the pathological case for LRU
+static Trace loop_trace(size_t slots) {
+    Trace t{"loop-1.2x", {}};
+    const uint64_t file = BlockCache::make_file_id(1, 3);
+    const size_t loop = slots + slots / 5;
+    for (int pass = 0; pass < 20; ++pass) {
+        for (size_t b = 0; b < loop; ++b) t.accesses.push_back({file, b});
+    }
+    return t;
+}
+
+static bool load_trace(const char* path, Trace* out) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    out->name = path;
+    unsigned long long file_id, block_id;
+    while (fscanf(f, "%llu %llu", &file_id, &block_id) == 2) {
+        out->accesses.push_back({file_id, block_id});
+    }
+    fclose(f);
+    return true;
+}
+
+static void replay(const Trace& trace, size_t capacity_mb, EvictionPolicyType policy) {
+    BlockCache& cache = BlockCache::instance();
+    cache.init(capacity_mb, policy);
+
+    std::vector<uint8_t> block(BLOCK_SIZE, 0x11);
+    uint8_t out[64];
+    for (const Access& a : trace.accesses) {
+        if (cache.read(a.file_id, a.block_id * BLOCK_SIZE, sizeof(out), out) < 0) {
+            cache.put_block(a.file_id, a.block_id, block.data(), block.size());
+        }
+    }
+
+    BlockCacheStats s = cache.stats();
+    double ratio = s.hits + s.misses ? 100.0 * s.hits / (s.hits + s.misses) : 0.0;
+    printf("%-24s %-8s %10zu accesses   hit ratio %6.2f%%\n",
+           trace.name.c_str(), EvictionPolicy::name(policy), trace.accesses.size(), ratio);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    size_t capacity_mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 64;
+    if (capacity_mb == 0) capacity_mb = 64;
+    const size_t slots = capacity_mb * 1024 * 1024 / BLOCK_SIZE;
+
+    std::vector<Trace> traces;
+    for (int i = 2; i < argc; ++i) {
+        Trace t;
+        if (!load_trace(argv[i], &t)) {
+            fprintf(stderr, "cannot read trace %s\n", argv[i]);
+            return 1;
+        }
+        traces.push_back(std::move(t));
+    }
+    if (traces.empty()) {
+        traces.push_back(scan_with_hot_set(slots));
+        traces.push_back(zipf_trace(slots));
+        traces.push_back(loop_trace(slots));
+    }
+
+    printf("cache %zu MB (%zu slots)\n", capacity_mb, slots);
+    for (const Trace& t : traces) {
+        for (EvictionPolicyType p : {kEvictLru, kEvictS3Fifo}) {
+            run_forked([&] { replay(t, capacity_mb, p); });
+        }
+    }
+    return 0;
+}
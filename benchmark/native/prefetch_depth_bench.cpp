@@ -0,0 +1,167 @@
+// PrefetchEngine throughput vs READs in flight, against a simulated server.
+//
+// Build and run from the repository root:
+//   g++ -O2 -std=c++17 -pthread -Imacos/Classes -Imacos/Classes/libnfs/include
+//       -Imacos/Classes/libnfs/include/nfsc -o /tmp/prefetch_depth_bench
+//       benchmark/native/prefetch_depth_bench.cpp macos/Classes/prefetch_engine.cpp
+//       macos/Classes/block_cache.cpp macos/Classes/eviction_policy.cpp
+//       macos/Classes/slab_arena.cpp macos/Classes/disk_cache.cpp
+//       macos/Classes/compressed_pool.cpp macos/Classes/lz_codec.cpp
+//       macos/Classes/dedup_store.cpp
+//   /tmp/prefetch_depth_bench [rtt_ms] [link_MBps] [file_MB]
+//
+// The libnfs calls the engine makes are defined below instead of linking
+// libnfs: each READ is answered after half the round-trip time, queues behind
+// earlier replies for the link's bandwidth, and arrives half an RTT later.
+// One worker prefetches a whole file at each depth; throughput should grow
+// about linearly with depth until the link is saturated. Each depth runs in
+// a forked child because PrefetchEngine and BlockCache are process-wide
+// singletons.
+
+#include "block_cache.hpp"
+#include "prefetch_engine.hpp"
+#include <nfsc/libnfs.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static std::chrono::microseconds g_rtt(20000);
+static double g_link_bytes_per_us = 50.0 * 1024 * 1024 / 1e6; // 50MB/s
+static uint64_t g_file_size = 16ULL * 1024 * 1024;
+
+// --- Simulated server ---
+
+struct nfs_context {
+    struct Reply {
+        Clock::time_point due;
+        size_t count;
+        nfs_cb cb;
+        void* buf;
+        void* priv;
+    };
+    std::vector<Reply> replies; // in arrival order
+    Clock::time_point link_free;
+    int fds[2] = {-1, -1}; // always readable: nfs_service waits for replies
+};
+struct nfsfh {
+    int unused;
+};
+
+extern "C" {
+struct nfs_context* nfs_init_context(void) {
+    nfs_context* nfs = new nfs_context();
+    if (pipe(nfs->fds) != 0 || write(nfs->fds[1], "x", 1) != 1) abort();
+    return nfs;
+}
+void nfs_destroy_context(struct nfs_context* nfs) {
+    close(nfs->fds[0]);
+    close(nfs->fds[1]);
+    delete nfs;
+}
+int nfs_mount(struct nfs_context*, const char*, const char*) { return 0; }
+int nfs_umount(struct nfs_context*) { return 0; }
+void nfs_set_timeout(struct nfs_context*, int) {}
+char* nfs_get_error(struct nfs_context*) { return (char*)"simulated"; }
+int nfs_open(struct nfs_context*, const char*, int, struct nfsfh** fh) {
+    *fh = new nfsfh();
+    return 0;
+}
+int nfs_close(struct nfs_context*, struct nfsfh* fh) {
+    delete fh;
+    return 0;
+}
+int nfs_get_fd(struct nfs_context* nfs) { return nfs->fds[0]; }
+int nfs_which_events(struct nfs_context*) { return POLLIN; }
+
+int nfs_pread_async(struct nfs_context* nfs, struct nfsfh*, void* buf, size_t count, uint64_t offset, nfs_cb cb,
+                    void* priv) {
+    count = (size_t)std::min<uint64_t>(count, offset < g_file_size ? g_file_size - offset : 0);
+    Clock::time_point at_server = Clock::now() + g_rtt / 2;
+    Clock::time_point sent = std::max(at_server, nfs->link_free) +
+                             std::chrono::microseconds((int64_t)(count / g_link_bytes_per_us));
+    nfs->link_free = sent;
+    nfs->replies.push_back({sent + g_rtt / 2, count, cb, buf, priv});
+    return 0;
+}
+
+// Runs the callbacks of the replies that arrived, after waiting up to 1ms
+// for the first one, as poll would
+int nfs_service(struct nfs_context* nfs, int) {
+    if (nfs->replies.empty()) return 0;
+    Clock::time_point first = nfs->replies.front().due;
+    if (first > Clock::now()) std::this_thread::sleep_until(std::min(first, Clock::now() + std::chrono::milliseconds(1)));
+    Clock::time_point now = Clock::now();
+    size_t n = 0;
+    while (n < nfs->replies.size() && nfs->replies[n].due <= now) ++n;
+    std::vector<nfs_context::Reply> arrived(nfs->replies.begin(), nfs->replies.begin() + n);
+    nfs->replies.erase(nfs->replies.begin(), nfs->replies.begin() + n);
+    for (const auto& r : arrived) r.cb((int)r.count, nfs, r.buf, r.priv);
+    return 0;
+}
+}
+
+// --- Benchmark ---
+
+static void run_forked(const std::function<void()>& fn) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        fn();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+}
+
+static void prefetch_file(int depth) {
+    BlockCache& cache = BlockCache::instance();
+    cache.init(g_file_size / (1024 * 1024) * 2 + 16);
+    const uint64_t file_id = BlockCache::make_file_id(1, 1);
+    const uint64_t blocks = (g_file_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    cache.set_file_size(file_id, g_file_size);
+
+    PrefetchEngine& engine = PrefetchEngine::instance();
+    engine.add_file(file_id, "server", "/export", "disc.iso");
+    engine.set_depth(depth);
+    engine.start(1);
+
+    auto begin = Clock::now();
+    for (uint64_t b = 0; b < blocks; ++b) engine.enqueue(file_id, b);
+    while (engine.stats().fetched + engine.stats().failed < blocks) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double secs = std::chrono::duration<double>(Clock::now() - begin).count();
+    PrefetchStats s = engine.stats();
+    engine.start(0);
+
+    printf("depth %2d   %8.1f MB/s   avg READ %7.1f ms   %llu/%llu blocks\n", depth,
+           s.fetched_bytes / secs / (1024 * 1024), s.fetched ? s.fetch_us / 1000.0 / s.fetched : 0.0,
+           (unsigned long long)s.fetched, (unsigned long long)blocks);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) g_rtt = std::chrono::microseconds((int64_t)(atof(argv[1]) * 1000));
+    if (argc > 2) g_link_bytes_per_us = atof(argv[2]) * 1024 * 1024 / 1e6;
+    if (argc > 3) g_file_size = strtoull(argv[3], nullptr, 10) * 1024 * 1024;
+    if (g_link_bytes_per_us <= 0 || g_file_size == 0) {
+        fprintf(stderr, "usage: %s [rtt_ms] [link_MBps] [file_MB]\n", argv[0]);
+        return 1;
+    }
+
+    printf("rtt %.1f ms, link %.0f MB/s, %llu MB file, one worker\n", g_rtt.count() / 1000.0,
+           g_link_bytes_per_us * 1e6 / (1024 * 1024), (unsigned long long)(g_file_size / (1024 * 1024)));
+    for (int depth : {1, 2, 4, 8, 16, 32}) {
+        run_forked([depth] { prefetch_file(depth); });
+    }
+    return 0;
+}
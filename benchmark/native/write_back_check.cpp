@@ -0,0 +1,280 @@
+// Write-back checks for the libretro VFS, against an in-memory server.
+//
+// Build and run from the repository root:
+//   g++ -O1 -g -std=c++17 -pthread -Imacos/Classes -Imacos/Classes/libnfs/include
+//       -Imacos/Classes/libnfs/include/nfsc -o /tmp/write_back_check
+//       benchmark/native/write_back_check.cpp macos/Classes/libretro_vfs_impl.cpp
+//       macos/Classes/prefetch_engine.cpp macos/Classes/access_pattern.cpp
+//       macos/Classes/delta_write.cpp macos/Classes/block_cache.cpp
+//       macos/Classes/eviction_policy.cpp macos/Classes/slab_arena.cpp
+//       macos/Classes/disk_cache.cpp macos/Classes/compressed_pool.cpp
+//       macos/Classes/lz_codec.cpp macos/Classes/dedup_store.cpp
+//   /tmp/write_back_check
+//
+// The libnfs calls the VFS makes are defined below instead of linking
+// libnfs: one file held in memory, with READ, WRITE and COMMIT counted and
+// WRITEs failing on demand. Each check runs in a forked child because the
+// VFS and BlockCache are process-wide singletons. Prints one line per check
+// and exits non-zero if any failed.
+
+#include "block_cache.hpp"
+#include "libretro_defines.h"
+#include <nfsc/libnfs.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern "C" struct retro_vfs_interface* get_libretro_vfs();
+extern "C" void nfs_vfs_add_path_hint(const char* path, const char* server, const char* export_path,
+                                      const char* file);
+extern "C" void nfs_vfs_set_write_back(int enabled, int flush_interval_ms, int max_dirty_mb);
+
+// --- Simulated server ---
+
+static std::mutex g_server_mutex;
+static std::vector<uint8_t> g_file;
+static int g_reads = 0;
+static int g_writes = 0;
+static int g_commits = 0;
+static bool g_fail_writes = false;
+
+struct nfs_context {
+    int fds[2] = {-1, -1}; // always readable; async READs complete at once
+};
+struct nfsfh {
+    int unused;
+};
+
+extern "C" {
+struct nfs_context* nfs_init_context(void) {
+    nfs_context* nfs = new nfs_context();
+    if (pipe(nfs->fds) != 0 || write(nfs->fds[1], "x", 1) != 1) abort();
+    return nfs;
+}
+void nfs_destroy_context(struct nfs_context* nfs) {
+    close(nfs->fds[0]);
+    close(nfs->fds[1]);
+    delete nfs;
+}
+int nfs_mount(struct nfs_context*, const char*, const char*) { return 0; }
+int nfs_umount(struct nfs_context*) { return 0; }
+void nfs_set_timeout(struct nfs_context*, int) {}
+char* nfs_get_error(struct nfs_context*) { return (char*)"simulated"; }
+struct nfs_url* nfs_parse_url_dir(struct nfs_context*, const char*) { return nullptr; }
+void nfs_destroy_url(struct nfs_url*) {}
+size_t nfs_get_readmax(struct nfs_context*) { return 1024 * 1024; }
+int nfs_open(struct nfs_context*, const char*, int, struct nfsfh** fh) {
+    *fh = new nfsfh();
+    return 0;
+}
+int nfs_close(struct nfs_context*, struct nfsfh* fh) {
+    delete fh;
+    return 0;
+}
+int nfs_fstat64(struct nfs_context*, struct nfsfh*, struct nfs_stat_64* st) {
+    std::lock_guard<std::mutex> lock(g_server_mutex);
+    memset(st, 0, sizeof(*st));
+    st->nfs_dev = 1;
+    st->nfs_ino = 1;
+    st->nfs_size = g_file.size();
+    return 0;
+}
+int nfs_stat64(struct nfs_context* nfs, const char*, struct nfs_stat_64* st) {
+    return nfs_fstat64(nfs, nullptr, st);
+}
+int nfs_pread(struct nfs_context*, struct nfsfh*, void* buf, size_t count, uint64_t offset) {
+    std::lock_guard<std::mutex> lock(g_server_mutex);
+    g_reads++;
+    if (offset >= g_file.size()) return 0;
+    size_t n = std::min<size_t>(count, g_file.size() - offset);
+    memcpy(buf, g_file.data() + offset, n);
+    return (int)n;
+}
+int nfs_pwrite(struct nfs_context*, struct nfsfh*, const void* buf, size_t count, uint64_t offset) {
+    std::lock_guard<std::mutex> lock(g_server_mutex);
+    if (g_fail_writes) return -5; // -EIO
+    g_writes++;
+    if (offset + count > g_file.size()) g_file.resize(offset + count);
+    memcpy(g_file.data() + offset, buf, count);
+    return (int)count;
+}
+int nfs_fsync(struct nfs_context*, struct nfsfh*) {
+    std::lock_guard<std::mutex> lock(g_server_mutex);
+    g_commits++;
+    return 0;
+}
+int nfs_get_fd(struct nfs_context* nfs) { return nfs->fds[0]; }
+int nfs_which_events(struct nfs_context*) { return POLLIN; }
+int nfs_service(struct nfs_context*, int) { return 0; }
+int nfs_pread_async(struct nfs_context* nfs, struct nfsfh* fh, void* buf, size_t count, uint64_t offset, nfs_cb cb,
+                    void* priv) {
+    cb(nfs_pread(nfs, fh, buf, count, offset), nfs, buf, priv);
+    return 0;
+}
+}
+
+// --- Checks ---
+
+static const char* kPath = "nfs://server/export/game.srm";
+static const size_t kFileSize = 300000; // two full blocks and a tail
+
+static bool g_ok = true;
+static FILE* g_log = stdout; // the VFS logs to stdout; a check's child silences it
+
+static void expect(bool cond, const char* what) {
+    if (!cond) {
+        fprintf(g_log, "  FAILED: %s\n", what);
+        g_ok = false;
+    }
+}
+
+static std::vector<uint8_t> server_copy() {
+    std::lock_guard<std::mutex> lock(g_server_mutex);
+    return g_file;
+}
+
+static std::vector<uint8_t> read_all(retro_vfs_interface* vfs, retro_vfs_file_handle* h, size_t len) {
+    std::vector<uint8_t> out(len);
+    vfs->seek(h, 0, RETRO_VFS_SEEK_POSITION_START);
+    size_t done = 0;
+    while (done < len) {
+        int64_t n = vfs->read(h, out.data() + done, len - done);
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    out.resize(done);
+    return out;
+}
+
+static void write_at(retro_vfs_interface* vfs, retro_vfs_file_handle* h, std::vector<uint8_t>& expected,
+                     uint64_t offset, uint8_t value, size_t len) {
+    std::vector<uint8_t> data(len, value);
+    vfs->seek(h, offset, RETRO_VFS_SEEK_POSITION_START);
+    expect(vfs->write(h, data.data(), len) == (int64_t)len, "write returns its length");
+    if (offset + len > expected.size()) expected.resize(offset + len);
+    memcpy(expected.data() + offset, data.data(), len);
+}
+
+static void setup() {
+    BlockCache::instance().init(16);
+    g_file.resize(kFileSize);
+    for (size_t i = 0; i < g_file.size(); ++i) g_file[i] = (uint8_t)(i * 31);
+    nfs_vfs_add_path_hint(kPath, "server", "/export", "game.srm");
+    nfs_vfs_set_write_back(1, 60000, 64); // nothing written back behind our back
+}
+
+// Small writes across blocks and past EOF stay in memory and read back
+// through the writer and a second handle
+static void check_overlay() {
+    setup();
+    retro_vfs_interface* vfs = get_libretro_vfs();
+    std::vector<uint8_t> expected = server_copy();
+    retro_vfs_file_handle* h = vfs->open(kPath, RETRO_VFS_FILE_ACCESS_READ_WRITE, 0);
+    for (int i = 0; i < 700; ++i) write_at(vfs, h, expected, (uint64_t)i * 512, (uint8_t)i, 512);
+    expect(g_writes == 0, "no WRITE before a flush");
+    expect(vfs->size(h) == (int64_t)expected.size(), "size includes the appended bytes");
+    expect(read_all(vfs, h, expected.size()) == expected, "writer reads its writes");
+    retro_vfs_file_handle* reader = vfs->open(kPath, RETRO_VFS_FILE_ACCESS_READ, 0);
+    expect(read_all(vfs, reader, expected.size()) == expected, "second handle reads them too");
+    vfs->close(reader);
+    vfs->close(h);
+}
+
+// A flush writes everything back in a few large WRITEs and one COMMIT
+static void check_coalesced_flush() {
+    setup();
+    retro_vfs_interface* vfs = get_libretro_vfs();
+    std::vector<uint8_t> expected = server_copy();
+    retro_vfs_file_handle* h = vfs->open(kPath, RETRO_VFS_FILE_ACCESS_READ_WRITE, 0);
+    for (int i = 0; i < 700; ++i) write_at(vfs, h, expected, (uint64_t)i * 512, (uint8_t)i, 512);
+    expect(vfs->flush(h) == 0, "flush succeeds");
+    expect(server_copy() == expected, "server holds the writes");
+    expect(g_writes <= 2, "adjacent blocks go out in one WRITE");
+    expect(g_commits == 1, "flush COMMITs once");
+    expect(BlockCache::instance().stats().dirty_bytes == 0, "nothing left dirty");
+    vfs->close(h);
+}
+
+// Closing the last handle writes back and COMMITs
+static void check_flush_on_close() {
+    setup();
+    retro_vfs_interface* vfs = get_libretro_vfs();
+    std::vector<uint8_t> expected = server_copy();
+    retro_vfs_file_handle* h = vfs->open(kPath, RETRO_VFS_FILE_ACCESS_READ_WRITE, 0);
+    write_at(vfs, h, expected, 5, 0xEE, 10);
+    expect(vfs->close(h) == 0, "close succeeds");
+    expect(server_copy() == expected, "server holds the write");
+    expect(g_commits == 1, "close COMMITs");
+}
+
+// A write to a pinned block leaves the pin holder's view alone
+static void check_pinned_write() {
+    setup();
+    retro_vfs_interface* vfs = get_libretro_vfs();
+    std::vector<uint8_t> expected = server_copy();
+    retro_vfs_file_handle* h = vfs->open(kPath, RETRO_VFS_FILE_ACCESS_READ_WRITE, 0);
+    read_all(vfs, h, expected.size());
+    BlockCache::Pin pin = BlockCache::instance().pin_block(BlockCache::make_file_id(1, 1), 0);
+    expect((bool)pin, "block 0 pins");
+    if (!pin) return;
+    std::vector<uint8_t> before(pin.data(), pin.data() + pin.size());
+    write_at(vfs, h, expected, 100, 0x55, 4096);
+    expect(std::equal(before.begin(), before.end(), pin.data()), "pin keeps what it saw");
+    expect(read_all(vfs, h, expected.size()) == expected, "reads see the write");
+    expect(vfs->flush(h) == 0 && server_copy() == expected, "flush writes the new contents back");
+    vfs->close(h);
+}
+
+// A close whose write-back fails keeps the data for the next writer
+static void check_failed_close() {
+    setup();
+    retro_vfs_interface* vfs = get_libretro_vfs();
+    std::vector<uint8_t> original = server_copy();
+    std::vector<uint8_t> expected = original;
+    retro_vfs_file_handle* h = vfs->open(kPath, RETRO_VFS_FILE_ACCESS_READ_WRITE, 0);
+    write_at(vfs, h, expected, 1000, 0x42, 2000);
+    g_fail_writes = true;
+    expect(vfs->close(h) == -1, "close reports the failure");
+    expect(server_copy() == original, "server unchanged");
+    retro_vfs_file_handle* reader = vfs->open(kPath, RETRO_VFS_FILE_ACCESS_READ, 0);
+    expect(read_all(vfs, reader, expected.size()) == expected, "write still readable");
+    vfs->close(reader);
+    g_fail_writes = false;
+    h = vfs->open(kPath, RETRO_VFS_FILE_ACCESS_READ_WRITE, 0);
+    expect(server_copy() == expected, "next writable open writes it back");
+    expect(vfs->close(h) == 0 && g_commits == 1, "and COMMITs it on close");
+}
+
+static bool run_forked(const char* name, const std::function<void()>& fn) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        g_log = fdopen(dup(STDOUT_FILENO), "w");
+        if (!g_log || !freopen("/dev/null", "w", stdout)) _exit(2);
+        fn();
+        fprintf(g_log, "%-20s %s\n", name, g_ok ? "ok" : "FAILED");
+        fflush(g_log);
+        _exit(g_ok ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status)) printf("%-20s crashed\n", name);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main() {
+    bool ok = true;
+    ok &= run_forked("overlay", check_overlay);
+    ok &= run_forked("coalesced flush", check_coalesced_flush);
+    ok &= run_forked("flush on close", check_flush_on_close);
+    ok &= run_forked("pinned write", check_pinned_write);
+    ok &= run_forked("failed close", check_failed_close);
+    return ok ? 0 : 1;
+}
@@ -129,6 +129,25 @@ class NfsBindings {
   void Function(Pointer<Utf8>, Pointer<Utf8>, Pointer<Utf8>, Pointer<Utf8>)?
       nfs_vfs_add_path_hint;
 
+  // void nfs_vfs_set_write_back(int enabled, int flush_interval_ms, int max_dirty_mb)
+  void Function(int, int, int)? nfs_vfs_set_write_back;
+
+  // void nfs_vfs_set_delta_writes(int enabled)
+  void Function(int)? nfs_vfs_set_delta_writes;
+
+  // void nfs_vfs_set_partition(int partition)
+  void Function(int)? nfs_vfs_set_partition;
+
+  // void nfs_vfs_set_read_extent(int kb)
+  void Function(int)? nfs_vfs_set_read_extent;
+
+  // void nfs_vfs_set_readahead_max(int kb)
+  void Function(int)? nfs_vfs_set_readahead_max;
+
+  // int bridge_nfs_delta_pwrite(struct nfs_context *nfs, struct nfsfh *nfsfh, uint64_t file_id, const uint8_t *buf, size_t count, uint64_t offset);
+  int Function(Pointer<NfsContext>, Pointer<NfsFh>, int, Pointer<Uint8>, int,
+      int)? nfs_delta_pwrite;
+
   NfsBindings._() {
     _lib = _loadLibrary();
     _bindFunctions();
@@ -359,6 +378,40 @@ class NfsBindings {
           .lookup<NativeFunction<Void Function(Int32)>>('cache_init')
           .asFunction();
     });
+    bindOptional('cache_preload', (lib) {
+      cache_preload = lib
+          .lookup<
+              NativeFunction<
+                  Pointer<Void> Function(Pointer<Utf8>, Pointer<Utf8>,
+                      Pointer<Utf8>, Uint64, Uint64, Int32)>>('cache_preload')
+          .asFunction();
+      cache_preload_progress = lib
+          .lookup<
+              NativeFunction<
+                  Int32 Function(Pointer<Void>, Pointer<Uint64>,
+                      Pointer<Uint64>)>>('cache_preload_progress')
+          .asFunction();
+      cache_preload_release = lib
+          .lookup<NativeFunction<Void Function(Pointer<Void>)>>(
+              'cache_preload_release')
+          .asFunction();
+    });
+    bindOptional('cache_init_with_policy', (lib) {
+      cache_init_with_policy = lib
+          .lookup<NativeFunction<Void Function(Int32, Int32)>>(
+              'cache_init_with_policy')
+          .asFunction();
+    });
+    bindOptional('cache_resize', (lib) {
+      cache_resize = lib
+          .lookup<NativeFunction<Int32 Function(Int32)>>('cache_resize')
+          .asFunction();
+    });
+    bindOptional('cache_trim', (lib) {
+      cache_trim = lib
+          .lookup<NativeFunction<Int64 Function(Int32)>>('cache_trim')
+          .asFunction();
+    });
     bindOptional('cache_read', (lib) {
       cache_read = lib
           .lookup<
@@ -372,6 +425,154 @@ class NfsBindings {
               'cache_put')
           .asFunction();
     });
+    bindOptional('cache_make_file_id', (lib) {
+      cache_make_file_id = lib
+          .lookup<NativeFunction<Uint64 Function(Uint64, Uint64)>>(
+              'cache_make_file_id')
+          .asFunction();
+    });
+    bindOptional('cache_file_read', (lib) {
+      cache_file_read = lib
+          .lookup<
+              NativeFunction<
+                  Int32 Function(Uint64, Uint64, Int32,
+                      Pointer<Uint8>)>>('cache_file_read')
+          .asFunction();
+    });
+    bindOptional('cache_file_put', (lib) {
+      cache_file_put = lib
+          .lookup<
+              NativeFunction<
+                  Void Function(Uint64, Uint64, Pointer<Uint8>,
+                      Int32)>>('cache_file_put')
+          .asFunction();
+    });
+    bindOptional('cache_file_set_size', (lib) {
+      cache_file_set_size = lib
+          .lookup<NativeFunction<Void Function(Uint64, Uint64)>>(
+              'cache_file_set_size')
+          .asFunction();
+      cache_file_size = lib
+          .lookup<NativeFunction<Int64 Function(Uint64)>>('cache_file_size')
+          .asFunction();
+    });
+    bindOptional('cache_enable_disk', (lib) {
+      cache_enable_disk = lib
+          .lookup<NativeFunction<Int32 Function(Pointer<Utf8>, Int32)>>(
+              'cache_enable_disk')
+          .asFunction();
+      cache_make_change_attr = lib
+          .lookup<NativeFunction<Uint64 Function(Uint64, Uint64, Uint64)>>(
+              'cache_make_change_attr')
+          .asFunction();
+      cache_file_set_change = lib
+          .lookup<NativeFunction<Void Function(Uint64, Uint64)>>(
+              'cache_file_set_change')
+          .asFunction();
+    });
+    bindOptional('cache_file_invalidate', (lib) {
+      cache_file_invalidate = lib
+          .lookup<NativeFunction<Void Function(Uint64)>>(
+              'cache_file_invalidate')
+          .asFunction();
+      cache_file_invalidate_range = lib
+          .lookup<NativeFunction<Void Function(Uint64, Uint64, Uint64)>>(
+              'cache_file_invalidate_range')
+          .asFunction();
+      cache_file_revalidate = lib
+          .lookup<NativeFunction<Int32 Function(Uint64, Uint64)>>(
+              'cache_file_revalidate')
+          .asFunction();
+    });
+    bindOptional('cache_enable_compression', (lib) {
+      cache_enable_compression = lib
+          .lookup<NativeFunction<Void Function(Int32)>>(
+              'cache_enable_compression')
+          .asFunction();
+    });
+    bindOptional('cache_enable_dedup', (lib) {
+      cache_enable_dedup = lib
+          .lookup<NativeFunction<Void Function(Int32)>>('cache_enable_dedup')
+          .asFunction();
+    });
+    bindOptional('cache_create_partition', (lib) {
+      cache_create_partition = lib
+          .lookup<NativeFunction<Int32 Function(Pointer<Utf8>, Int32, Int32)>>(
+              'cache_create_partition')
+          .asFunction();
+      cache_file_set_partition = lib
+          .lookup<NativeFunction<Void Function(Uint64, Int32)>>(
+              'cache_file_set_partition')
+          .asFunction();
+      cache_get_partition_stats = lib
+          .lookup<
+              NativeFunction<
+                  Int32 Function(Int32, Pointer<CachePartitionStats>)>>(
+              'cache_get_partition_stats')
+          .asFunction();
+    });
+    bindOptional('cache_file_set_extent', (lib) {
+      cache_file_set_extent = lib
+          .lookup<NativeFunction<Void Function(Uint64, Int32)>>(
+              'cache_file_set_extent')
+          .asFunction();
+    });
+    bindOptional('cache_file_has_block', (lib) {
+      cache_file_has_block = lib
+          .lookup<NativeFunction<Int32 Function(Uint64, Uint64)>>(
+              'cache_file_has_block')
+          .asFunction();
+    });
+    bindOptional('cache_file_claim', (lib) {
+      cache_file_claim = lib
+          .lookup<NativeFunction<Int32 Function(Uint64, Uint64)>>(
+              'cache_file_claim')
+          .asFunction();
+      cache_file_complete = lib
+          .lookup<
+              NativeFunction<
+                  Void Function(Uint64, Uint64, Pointer<Uint8>,
+                      Int32)>>('cache_file_complete')
+          .asFunction();
+      cache_file_fail = lib
+          .lookup<NativeFunction<Void Function(Uint64, Uint64)>>(
+              'cache_file_fail')
+          .asFunction();
+    });
+    bindOptional('cache_file_claim_buffer', (lib) {
+      cache_file_claim_buffer = lib
+          .lookup<NativeFunction<Pointer<Uint8> Function(Uint64, Uint64)>>(
+              'cache_file_claim_buffer')
+          .asFunction();
+      cache_file_commit = lib
+          .lookup<NativeFunction<Void Function(Uint64, Uint64, Int32)>>(
+              'cache_file_commit')
+          .asFunction();
+    });
+    bindOptional('cache_get_stats', (lib) {
+      cache_get_stats = lib
+          .lookup<NativeFunction<Void Function(Pointer<BlockCacheStats>)>>(
+              'cache_get_stats')
+          .asFunction();
+    });
+    bindOptional('cache_set_wait_spin_us', (lib) {
+      cache_set_wait_spin_us = lib
+          .lookup<NativeFunction<Void Function(Int32)>>(
+              'cache_set_wait_spin_us')
+          .asFunction();
+    });
+    bindOptional('cache_pin_block', (lib) {
+      cache_pin_block = lib
+          .lookup<
+              NativeFunction<
+                  Pointer<Void> Function(Uint64, Uint64,
+                      Pointer<Pointer<Uint8>>, Pointer<Int32>)>>(
+              'cache_pin_block')
+          .asFunction();
+      cache_unpin_block_ptr =
+          lib.lookup<NativeFinalizerFunction>('cache_unpin_block');
+      cache_unpin_block = cache_unpin_block_ptr!.asFunction();
+    });
     bindOptional('cache_has_block', (lib) {
       cache_has_block = lib
           .lookup<NativeFunction<Int32 Function(Uint64)>>('cache_has_block')
@@ -402,6 +603,30 @@ class NfsBindings {
               'nfs_set_prefetch_callback')
           .asFunction();
     });
+    bindOptional('nfs_register_prefetch_callback', (lib) {
+      nfs_register_prefetch_callback = lib
+          .lookup<
+                  NativeFunction<
+                      Void Function(Uint64,
+                          Pointer<NativeFunction<Void Function(Uint64)>>)>>(
+              'nfs_register_prefetch_callback')
+          .asFunction();
+    });
+    bindOptional('nfs_prefetch_start', (lib) {
+      nfs_prefetch_start = lib
+          .lookup<NativeFunction<Void Function(Int32)>>('nfs_prefetch_start')
+          .asFunction();
+      nfs_prefetch_get_stats = lib
+          .lookup<NativeFunction<Void Function(Pointer<PrefetchStats>)>>(
+              'nfs_prefetch_get_stats')
+          .asFunction();
+    });
+    bindOptional('nfs_prefetch_set_depth', (lib) {
+      nfs_prefetch_set_depth = lib
+          .lookup<NativeFunction<Void Function(Int32)>>(
+              'nfs_prefetch_set_depth')
+          .asFunction();
+    });
     bindOptional('nfs_set_log_callback', (lib) {
       nfs_set_log_callback = lib
           .lookup<
@@ -411,6 +636,44 @@ class NfsBindings {
               'nfs_set_log_callback')
           .asFunction();
     });
+    bindOptional('nfs_vfs_set_write_back', (lib) {
+      nfs_vfs_set_write_back = lib
+          .lookup<NativeFunction<Void Function(Int32, Int32, Int32)>>(
+              'nfs_vfs_set_write_back')
+          .asFunction();
+    });
+    bindOptional('nfs_vfs_set_delta_writes', (lib) {
+      nfs_vfs_set_delta_writes = lib
+          .lookup<NativeFunction<Void Function(Int32)>>(
+              'nfs_vfs_set_delta_writes')
+          .asFunction();
+    });
+    bindOptional('nfs_vfs_set_partition', (lib) {
+      nfs_vfs_set_partition = lib
+          .lookup<NativeFunction<Void Function(Int32)>>(
+              'nfs_vfs_set_partition')
+          .asFunction();
+    });
+    bindOptional('nfs_vfs_set_read_extent', (lib) {
+      nfs_vfs_set_read_extent = lib
+          .lookup<NativeFunction<Void Function(Int32)>>(
+              'nfs_vfs_set_read_extent')
+          .asFunction();
+    });
+    bindOptional('nfs_vfs_set_readahead_max', (lib) {
+      nfs_vfs_set_readahead_max = lib
+          .lookup<NativeFunction<Void Function(Int32)>>(
+              'nfs_vfs_set_readahead_max')
+          .asFunction();
+    });
+    bindOptional('bridge_nfs_delta_pwrite', (lib) {
+      nfs_delta_pwrite = lib
+          .lookup<
+              NativeFunction<
+                  Int32 Function(Pointer<NfsContext>, Pointer<NfsFh>, Uint64,
+                      Pointer<Uint8>, Size, Uint64)>>('bridge_nfs_delta_pwrite')
+          .asFunction();
+    });
     bindOptional('nfs_vfs_add_path_hint', (lib) {
       nfs_vfs_add_path_hint = lib
           .lookup<
@@ -423,16 +686,59 @@ class NfsBindings {
 
   // --- Cache API ---
   void Function(int)? cache_init;
+  void Function(int, int)? cache_init_with_policy;
+  Pointer<Void> Function(
+          Pointer<Utf8>, Pointer<Utf8>, Pointer<Utf8>, int, int, int)?
+      cache_preload;
+  int Function(Pointer<Void>, Pointer<Uint64>, Pointer<Uint64>)?
+      cache_preload_progress;
+  void Function(Pointer<Void>)? cache_preload_release;
+  int Function(int)? cache_resize;
+  int Function(int)? cache_trim;
   int Function(int, int, Pointer<Uint8>)? cache_read;
   void Function(int, Pointer<Uint8>, int)? cache_put;
   int Function(int)? cache_has_block;
   int Function()? cache_get_block_size;
+  int Function(int, int)? cache_make_file_id;
+  int Function(int, int, int, Pointer<Uint8>)? cache_file_read;
+  void Function(int, int, Pointer<Uint8>, int)? cache_file_put;
+  int Function(int, int)? cache_file_has_block;
+  void Function(int, int)? cache_file_set_size;
+  int Function(int)? cache_file_size;
+  int Function(Pointer<Utf8>, int)? cache_enable_disk;
+  int Function(int, int, int)? cache_make_change_attr;
+  void Function(int, int)? cache_file_set_change;
+  int Function(int, int)? cache_file_revalidate;
+  void Function(int)? cache_file_invalidate;
+  void Function(int, int, int)? cache_file_invalidate_range;
+  void Function(int)? cache_enable_compression;
+  void Function(int)? cache_enable_dedup;
+  int Function(Pointer<Utf8>, int, int)? cache_create_partition;
+  void Function(int, int)? cache_file_set_partition;
+  int Function(int, Pointer<CachePartitionStats>)? cache_get_partition_stats;
+  void Function(int, int)? cache_file_set_extent;
+  int Function(int, int)? cache_file_claim;
+  void Function(int, int, Pointer<Uint8>, int)? cache_file_complete;
+  void Function(int, int)? cache_file_fail;
+  Pointer<Uint8> Function(int, int)? cache_file_claim_buffer;
+  void Function(int, int, int)? cache_file_commit;
+  void Function(Pointer<BlockCacheStats>)? cache_get_stats;
+  void Function(int)? cache_set_wait_spin_us;
+  Pointer<Void> Function(int, int, Pointer<Pointer<Uint8>>, Pointer<Int32>)?
+      cache_pin_block;
+  void Function(Pointer<Void>)? cache_unpin_block;
+  Pointer<NativeFinalizerFunction>? cache_unpin_block_ptr;
 
   // --- VFS API ---
   Pointer<Void> Function()? get_libretro_vfs;
   void Function(Pointer<Void>, Pointer<Void>)? bridge_fill_vfs_info;
   void Function(Pointer<NativeFunction<Void Function(Uint64)>>)?
       nfs_set_prefetch_callback;
+  void Function(int, Pointer<NativeFunction<Void Function(Uint64)>>)?
+      nfs_register_prefetch_callback;
+  void Function(int)? nfs_prefetch_start;
+  void Function(Pointer<PrefetchStats>)? nfs_prefetch_get_stats;
+  void Function(int)? nfs_prefetch_set_depth;
   void Function(Pointer<NativeFunction<DartLogCallbackNative>>)?
       nfs_set_log_callback;
 }
@@ -463,6 +769,169 @@ final class NfsUrl extends Struct {
   external Pointer<Utf8> file;
 }
 
+/// Block cache counters, mirrors `BlockCacheStats` in block_cache.hpp
+final class BlockCacheStats extends Struct {
+  @Uint64()
+  external int hits;
+
+  @Uint64()
+  external int misses;
+
+  @Uint64()
+  external int fetch_claims;
+
+  @Uint64()
+  external int dedup_present;
+
+  @Uint64()
+  external int dedup_inflight;
+
+  @Uint64()
+  external int fetch_failures;
+
+  @Uint64()
+  external int resident_bytes;
+
+  @Uint64()
+  external int trimmed_bytes;
+
+  @Uint64()
+  external int disk_hits;
+
+  @Uint64()
+  external int disk_misses;
+
+  @Uint64()
+  external int disk_writes;
+
+  @Uint64()
+  external int disk_corrupt;
+
+  @Uint64()
+  external int compressed_stores;
+
+  @Uint64()
+  external int compressed_rejects;
+
+  @Uint64()
+  external int compressed_hits;
+
+  @Uint64()
+  external int compressed_raw_bytes;
+
+  @Uint64()
+  external int compressed_stored_bytes;
+
+  @Uint64()
+  external int compressed_resident_bytes;
+
+  @Uint64()
+  external int decompress_ns;
+
+  @Uint64()
+  external int dirty_bytes;
+
+  @Uint64()
+  external int absorbed_writes;
+
+  @Uint64()
+  external int flush_writes;
+
+  @Uint64()
+  external int flushed_bytes;
+
+  @Uint64()
+  external int delta_writes;
+
+  @Uint64()
+  external int delta_fallbacks;
+
+  @Uint64()
+  external int delta_bytes_sent;
+
+  @Uint64()
+  external int delta_bytes_saved;
+
+  @Uint64()
+  external int dedup_refs;
+
+  @Uint64()
+  external int dedup_unique;
+
+  @Uint64()
+  external int dedup_logical_bytes;
+
+  @Uint64()
+  external int dedup_stored_bytes;
+
+  @Uint64()
+  external int partial_fills;
+
+  @Uint64()
+  external int partial_hits;
+}
+
+/// Counters of one cache partition, mirrors `CachePartitionStats` in
+/// block_cache.hpp
+final class CachePartitionStats extends Struct {
+  @Uint64()
+  external int budget_bytes;
+
+  @Uint64()
+  external int resident_bytes;
+
+  @Uint64()
+  external int borrowed_bytes;
+
+  @Uint64()
+  external int hits;
+
+  @Uint64()
+  external int misses;
+}
+
+/// Counters of the native prefetch engine, mirrors `PrefetchStats` in
+/// prefetch_engine.hpp
+final class PrefetchStats extends Struct {
+  @Uint64()
+  external int requests;
+
+  @Uint64()
+  external int coalesced;
+
+  @Uint64()
+  external int overflows;
+
+  @Uint64()
+  external int fetched;
+
+  @Uint64()
+  external int skipped;
+
+  @Uint64()
+  external int failed;
+
+  @Uint64()
+  external int fetched_bytes;
+
+  @Uint64()
+  external int fetch_us;
+
+  @Uint64()
+  external int workers;
+
+  @Uint64()
+  external int depth;
+}
+
+/// Result codes of `cache_file_claim`
+// ignore: constant_identifier_names
+const int CACHE_CLAIMED = 0;
+// ignore: constant_identifier_names
+const int CACHE_PRESENT = 1;
+// ignore: constant_identifier_names
+const int CACHE_IN_FLIGHT = 2;
+
 /// NFS stat structure (64-bit)
 final class NfsStat64 extends Struct {
   @Uint64()
@@ -1,5 +1,6 @@
 import 'dart:convert';
 import 'dart:ffi';
+import 'dart:typed_data';
 
 import 'package:ffi/ffi.dart';
 
@@ -89,22 +90,308 @@ class NfsNativeClient {
   }
 
   /// Initialize the C++ Block Cache.
-  /// [capacityMb] defaults to 64MB if <= 0.
-  void initCache(int capacityMb) {
-    if (_bindings.cache_init != null) {
+  /// [capacityMb] defaults to 64MB if <= 0. Memory is committed as blocks
+  /// are cached, not up front; later calls resize the cache.
+  /// [policy] selects the eviction policy and is fixed by the first call;
+  /// use [NfsCacheEvictionPolicy.s3fifo] when large sequential reads
+  /// (streaming a disc image) would otherwise evict the frequently revisited
+  /// blocks.
+  void initCache(int capacityMb,
+      {NfsCacheEvictionPolicy policy = NfsCacheEvictionPolicy.lru}) {
+    final initWithPolicy = _bindings.cache_init_with_policy;
+    if (initWithPolicy != null) {
+      initWithPolicy(capacityMb, policy.index);
+    } else if (_bindings.cache_init != null) {
       _bindings.cache_init!(capacityMb);
     }
   }
 
+  /// Load [length] bytes at [offset] of the file at [url] (up to EOF if
+  /// [length] is null) into the Block Cache and pin them, so they never
+  /// miss: ROM headers, a disc's TOC, BIOS images, boot data. Runs in the
+  /// background over its own connection with at most [parallelism] reads in
+  /// flight; the returned handle reports progress (e.g. for a "preparing
+  /// game" screen) and keeps the blocks pinned until released. Returns null
+  /// if the native library lacks preloading.
+  NfsCachePreload? preloadCache(String url,
+      {int offset = 0, int? length, int parallelism = 4}) {
+    final preload = _bindings.cache_preload;
+    if (preload == null) return null;
+    final parsed = parseUrl(url);
+    final serverPtr = parsed.server.toNativeUtf8();
+    final exportPtr = parsed.path.toNativeUtf8();
+    final filePtr = parsed.file.toNativeUtf8();
+    try {
+      final handle = preload(serverPtr, exportPtr, filePtr, offset,
+          length ?? 0, parallelism);
+      if (handle == nullptr) return null;
+      return NfsCachePreload._(_bindings, handle);
+    } finally {
+      calloc.free(serverPtr);
+      calloc.free(exportPtr);
+      calloc.free(filePtr);
+    }
+  }
+
+  /// Add a persistent disk tier under the Block Cache, stored in
+  /// [directory] (e.g. the app's cache directory) and bounded to
+  /// [capacityMb], rounded down to whole segments. Blocks survive app
+  /// restarts and are reused as long as the file's size and mtime are
+  /// unchanged. Can only be enabled once; returns false if it is already
+  /// enabled, the directory is unusable or [capacityMb] is under 1.
+  bool enableDiskCache(String directory, int capacityMb) {
+    final enable = _bindings.cache_enable_disk;
+    if (enable == null) return false;
+    final dirPtr = directory.toNativeUtf8();
+    try {
+      return enable(dirPtr, capacityMb) == 0;
+    } finally {
+      calloc.free(dirPtr);
+    }
+  }
+
+  /// Keep blocks evicted from the Block Cache LZ-compressed in a secondary
+  /// pool of up to [budgetMb], on top of the cache capacity. A later miss on
+  /// such a block decompresses it (tens of microseconds) instead of fetching
+  /// it again. Pays off for compressible data such as disc images with
+  /// padding; incompressible blocks are not kept. 0 disables the pool.
+  void enableCompressedCache(int budgetMb) {
+    _bindings.cache_enable_compression?.call(budgetMb);
+  }
+
+  /// Keep one copy of cached blocks with identical contents, e.g. the same
+  /// BIOS in several folders, regional variants of an image or tracks
+  /// shared by a multi-disc set, so cache memory follows the unique data
+  /// rather than the number of files. Costs a hash of every fetched block.
+  /// Applies to blocks cached from now on; see [NfsCacheStats.dedupRatio].
+  void enableCacheDedup(bool enabled) {
+    _bindings.cache_enable_dedup?.call(enabled ? 1 : 0);
+  }
+
+  /// Switch libretro VFS writes to write-back. Writes then update cached
+  /// blocks and return at once; dirty data is written back in coalesced
+  /// WRITEs when the core flushes or closes the file (both also COMMIT, and
+  /// report failure if the data did not reach the server), after
+  /// [flushInterval], once more than [maxDirtyMb] is dirty, and when the
+  /// cache is trimmed. If the last handle of a file closes with its
+  /// write-back failing, the data stays cached and is written back when the
+  /// file is next opened for writing. Writes not yet written back are lost
+  /// if the app dies. Disabling writes back everything still dirty.
+  void setVfsWriteBack(bool enabled,
+      {Duration flushInterval = const Duration(seconds: 2),
+      int maxDirtyMb = 8}) {
+    _bindings.nfs_vfs_set_write_back
+        ?.call(enabled ? 1 : 0, flushInterval.inMilliseconds, maxDirtyMb);
+  }
+
+  /// Make libretro VFS writes that go straight to the server send only the
+  /// ranges that differ from the cached previous contents, e.g. when a core
+  /// saves a state over the last one. Falls back to a full write when the
+  /// range is not cached. Writes deferred by [setVfsWriteBack] are not
+  /// affected.
+  void setVfsDeltaWrites(bool enabled) {
+    _bindings.nfs_vfs_set_delta_writes?.call(enabled ? 1 : 0);
+  }
+
+  /// Create a Block Cache partition named [name] with a budget of
+  /// [capacityMb], or update the partition of that name. Blocks of files
+  /// assigned to it (see [open], [setFileCachePartition] and
+  /// [setVfsCachePartition]) are evicted only to make room for each other,
+  /// so e.g. a library scan cannot push out the running game's working set.
+  /// With [borrow], the partition may also fill capacity others leave idle;
+  /// those blocks are the first to go when an owner needs its budget back.
+  /// Files not assigned anywhere share what the partitions leave. Returns
+  /// the partition id, or null if the native library lacks partitions or
+  /// all are in use.
+  int? createCachePartition(String name, int capacityMb,
+      {bool borrow = true}) {
+    final create = _bindings.cache_create_partition;
+    if (create == null) return null;
+    final namePtr = name.toNativeUtf8();
+    try {
+      final id = create(namePtr, capacityMb, borrow ? 1 : 0);
+      return id < 0 ? null : id;
+    } finally {
+      calloc.free(namePtr);
+    }
+  }
+
+  /// Charge blocks of [fileId] cached from now on to [partition], an id
+  /// from [createCachePartition] (0 is the default partition)
+  void setFileCachePartition(int fileId, int partition) {
+    _bindings.cache_file_set_partition?.call(fileId, partition);
+  }
+
+  /// Charge files the libretro VFS opens from now on to [partition] (0 is
+  /// the default partition)
+  void setVfsCachePartition(int partition) {
+    _bindings.nfs_vfs_set_partition?.call(partition);
+  }
+
+  /// Fetch synchronous libretro VFS read misses of [fileId] in aligned
+  /// extents of [bytes] (rounded down to 4KB, at most 8MB), e.g. the
+  /// server's read size, so one READ brings in a miss's neighbourhood. 0
+  /// fetches what was asked. Applies to handles opened from now on.
+  void setFileCacheExtent(int fileId, int bytes) {
+    _bindings.cache_file_set_extent?.call(fileId, bytes);
+  }
+
+  /// Default fetch extent for files the libretro VFS opens from now on
+  /// (see [setFileCacheExtent]): [kb] KB, the server's maximum read size
+  /// when null, or exact reads when 0 (the default).
+  void setVfsReadExtent(int? kb) {
+    _bindings.nfs_vfs_set_read_extent?.call(kb ?? -1);
+  }
+
+  /// Cap the libretro VFS readahead window at [kb] KB (at most 8MB). The
+  /// window of each sequential or strided stream starts at two blocks and
+  /// doubles while the stream keeps going. When null (the default), the cap
+  /// is twice the bandwidth-delay product measured on the link.
+  void setVfsReadaheadMax(int? kb) {
+    _bindings.nfs_vfs_set_readahead_max?.call(kb ?? 0);
+  }
+
+  /// Run libretro VFS readahead natively on [workers] background threads
+  /// (at most 8) with NFS connections of their own, instead of through
+  /// prefetch callbacks into a Dart isolate such as NfsWorker. Each worker
+  /// keeps up to [depth] READs in flight (at most 32), so throughput is not
+  /// capped at one block per round trip. Blocks are read straight into the
+  /// Block Cache. Returns false if the native library lacks the prefetch
+  /// engine.
+  bool startNativePrefetch({int workers = 2, int depth = 8}) {
+    final start = _bindings.nfs_prefetch_start;
+    if (start == null) return false;
+    _bindings.nfs_prefetch_set_depth?.call(depth);
+    start(workers);
+    return true;
+  }
+
+  /// Stop the native prefetch engine; prefetch callbacks apply again
+  void stopNativePrefetch() {
+    _bindings.nfs_prefetch_start?.call(0);
+  }
+
+  /// Counters of the native prefetch engine, or null if the native library
+  /// lacks it
+  NfsPrefetchStats? get nativePrefetchStats {
+    final getStats = _bindings.nfs_prefetch_get_stats;
+    if (getStats == null) return null;
+    final out = calloc<PrefetchStats>();
+    try {
+      getStats(out);
+      return NfsPrefetchStats._(out.ref);
+    } finally {
+      calloc.free(out);
+    }
+  }
+
+  /// Counters of a cache partition, or null if [partition] does not exist
+  /// or the native library lacks partitions
+  NfsCachePartitionStats? cachePartitionStats(int partition) {
+    final getStats = _bindings.cache_get_partition_stats;
+    if (getStats == null) return null;
+    final out = calloc<CachePartitionStats>();
+    try {
+      if (getStats(partition, out) != 0) return null;
+      return NfsCachePartitionStats._(out.ref);
+    } finally {
+      calloc.free(out);
+    }
+  }
+
+  /// Grow or shrink the Block Cache at runtime, e.g. start small and scale
+  /// up when a large image is opened. Shrinking evicts blocks and returns
+  /// their memory to the OS. Returns false if the cache is not initialized.
+  bool resizeCache(int capacityMb) {
+    final resize = _bindings.cache_resize;
+    if (resize == null) return false;
+    return resize(capacityMb) == 0;
+  }
+
+  /// Shed Block Cache memory, e.g. from
+  /// `WidgetsBindingObserver.didHaveMemoryPressure` or Android trim-memory
+  /// callbacks. Blocks are dropped down to the [level]'s target and their
+  /// pages returned to the OS; capacity is kept, so the cache refills on
+  /// demand. Returns the number of bytes released.
+  int trimCache([NfsCacheTrimLevel level = NfsCacheTrimLevel.moderate]) {
+    return _bindings.cache_trim?.call(level.index) ?? 0;
+  }
+
+  /// Cap the adaptive spin (in microseconds) a cache reader performs before
+  /// parking while it waits for a block. 0 makes waiters park immediately,
+  /// which saves CPU on devices with few cores.
+  void setCacheWaitSpin(int limitUs) {
+    _bindings.cache_set_wait_spin_us?.call(limitUs);
+  }
+
   /// Read directly from the Block Cache (Zero-Copy from Cache).
+  /// [fileId] selects the cached file (see [NfsFile.fileId]); 0 is the
+  /// anonymous file used by the legacy single-file cache API.
   /// Returns number of bytes read, or -1 if any block is missing.
-  int readCached(int offset, int len, Pointer<Uint8> buffer) {
-    if (_bindings.cache_read != null) {
+  int readCached(int offset, int len, Pointer<Uint8> buffer,
+      {int fileId = 0}) {
+    if (_bindings.cache_file_read != null) {
+      return _bindings.cache_file_read!(fileId, offset, len, buffer);
+    }
+    if (fileId == 0 && _bindings.cache_read != null) {
       return _bindings.cache_read!(offset, len, buffer);
     }
     return -1;
   }
 
+  /// Snapshot of the Block Cache counters, or null if the native library
+  /// was built without them.
+  NfsCacheStats? cacheStats() {
+    final getStats = _bindings.cache_get_stats;
+    if (getStats == null) return null;
+    final out = calloc<BlockCacheStats>();
+    try {
+      getStats(out);
+      return NfsCacheStats._(out.ref);
+    } finally {
+      calloc.free(out);
+    }
+  }
+
+  /// Drop everything the Block Cache holds for [fileId], e.g. after learning
+  /// that the file changed on the server. Takes constant time however much
+  /// of the file is cached. VFS writes not yet written back are dropped too.
+  /// Files are also invalidated automatically when [open] sees a new
+  /// modification time.
+  void invalidateCachedFile(int fileId) {
+    _bindings.cache_file_invalidate?.call(fileId);
+  }
+
+  /// Drop the cached blocks of [fileId] overlapping [length] bytes at
+  /// [offset].
+  void invalidateCachedRange(int fileId, int offset, int length) {
+    _bindings.cache_file_invalidate_range?.call(fileId, offset, length);
+  }
+
+  /// Zero-copy view of a cached block.
+  ///
+  /// Returns a read-only [Uint8List] backed directly by the cache slot, or
+  /// null if the block is not cached. The block stays pinned (it cannot be
+  /// evicted or reused) until the returned list is garbage collected, so do
+  /// not hold on to it longer than needed. Do not write to it.
+  Uint8List? pinCachedBlock(int fileId, int blockId) {
+    final pin = _bindings.cache_pin_block;
+    final unpin = _bindings.cache_unpin_block_ptr;
+    if (pin == null || unpin == null) return null;
+
+    final outData = calloc<Pointer<Uint8>>();
+    final outLen = calloc<Int32>();
+    try {
+      final handle = pin(fileId, blockId, outData, outLen);
+      if (handle == nullptr) return null;
+      return outData.value
+          .asTypedList(outLen.value, finalizer: unpin, token: handle);
+    } finally {
+      calloc.free(outData);
+      calloc.free(outLen);
+    }
+  }
+
   /// Safe string decoding
   String _safeToString(Pointer<Utf8> ptr) {
     if (ptr == nullptr) return '';
@@ -220,8 +507,10 @@ class NfsNativeClient {
     }
   }
 
-  /// Open a file with specific flags (O_RDONLY, O_WRONLY, O_RDWR)
-  NfsFile open(String path, {int flags = O_RDONLY}) {
+  /// Open a file with specific flags (O_RDONLY, O_WRONLY, O_RDWR). Its
+  /// cached blocks are charged to [cachePartition] if given (see
+  /// [createCachePartition]).
+  NfsFile open(String path, {int flags = O_RDONLY, int? cachePartition}) {
     _ensureNotDisposed();
     _ensureMounted();
 
@@ -245,11 +534,34 @@ class NfsNativeClient {
           throw NfsException('Failed to stat $path: $lastError');
         }
         final size = stat.ref.nfs_size;
+        final fileId = _bindings.cache_make_file_id
+                ?.call(stat.ref.nfs_dev, stat.ref.nfs_ino) ??
+            0;
+        if (fileId != 0) {
+          // Key the disk tier by the file's current version, and drop what
+          // is cached of an older one
+          final change = _bindings.cache_make_change_attr?.call(
+              size, stat.ref.nfs_mtime, stat.ref.nfs_mtime_nsec);
+          if (change != null) {
+            final revalidate = _bindings.cache_file_revalidate;
+            if (revalidate != null) {
+              revalidate(fileId, change);
+            } else {
+              _bindings.cache_file_set_change?.call(fileId, change);
+            }
+          }
+          // Let the Block Cache answer reads at EOF without a round-trip
+          _bindings.cache_file_set_size?.call(fileId, size);
+          if (cachePartition != null) {
+            _bindings.cache_file_set_partition?.call(fileId, cachePartition);
+          }
+        }
         return NfsFile(
           bindings: _bindings,
           context: _context,
           handle: handle,
           size: size,
+          fileId: fileId,
         );
       } finally {
         calloc.free(stat);
@@ -475,3 +787,353 @@ class NfsParsedUrl {
 
   NfsParsedUrl(this.server, this.path, this.file);
 }
+
+/// Block Cache counters, see [NfsNativeClient.cacheStats]
+class NfsCacheStats {
+  /// Blocks served from the cache
+  final int hits;
+
+  /// Reads that stopped at a missing block
+  final int misses;
+
+  /// Fetches actually issued (one per granted claim)
+  final int fetchClaims;
+
+  /// Fetches skipped because the block was already cached
+  final int dedupPresent;
+
+  /// Fetches skipped because the same block was already being fetched
+  final int dedupInflight;
+
+  /// Claimed fetches that failed or were abandoned
+  final int fetchFailures;
+
+  /// Cache memory currently committed, in bytes
+  final int residentBytes;
+
+  /// Bytes returned to the OS by [NfsNativeClient.trimCache], in total
+  final int trimmedBytes;
+
+  /// Blocks promoted from the disk tier instead of fetched over NFS
+  final int diskHits;
+
+  /// Disk tier lookups that found nothing usable
+  final int diskMisses;
+
+  /// Blocks written to the disk tier
+  final int diskWrites;
+
+  /// Disk tier entries dropped because their checksum did not match
+  final int diskCorrupt;
+
+  /// Evicted blocks kept in the compressed pool
+  final int compressedStores;
+
+  /// Evicted blocks not kept because they did not compress well enough
+  final int compressedRejects;
+
+  /// Blocks served by decompressing from the compressed pool
+  final int compressedHits;
+
+  /// Uncompressed size of all blocks stored in the pool, in bytes
+  final int compressedRawBytes;
+
+  /// Compressed size of all blocks stored in the pool, in bytes
+  final int compressedStoredBytes;
+
+  /// Compressed pool memory currently held, in bytes
+  final int compressedResidentBytes;
+
+  /// Total time spent decompressing pool hits, in nanoseconds
+  final int decompressNs;
+
+  /// Memory held by VFS writes not yet written back, in bytes
+  final int dirtyBytes;
+
+  /// VFS writes absorbed by cached blocks (write-back mode)
+  final int absorbedWrites;
+
+  /// WRITE calls issued to write back dirty data, after coalescing
+  final int flushWrites;
+
+  /// Bytes written back
+  final int flushedBytes;
+
+  /// Writes sent through the delta path (see [NfsFile.deltaWrites] and
+  /// [NfsNativeClient.setVfsDeltaWrites]), fallbacks included
+  final int deltaWrites;
+
+  /// Delta writes sent whole because the cached copy was missing or stale
+  final int deltaFallbacks;
+
+  /// Bytes actually sent by delta writes
+  final int deltaBytesSent;
+
+  /// Bytes of delta writes not sent because they were unchanged
+  final int deltaBytesSaved;
+
+  /// Cached blocks sharing a deduplicated payload (see
+  /// [NfsNativeClient.enableCacheDedup])
+  final int dedupRefs;
+
+  /// Distinct payloads those blocks share
+  final int dedupUnique;
+
+  /// Bytes those blocks hold
+  final int dedupLogicalBytes;
+
+  /// Bytes of the distinct payloads actually kept
+  final int dedupStoredBytes;
+
+  /// Reads whose leftover 4KB sub-blocks were cached for blocks not
+  /// fetched whole
+  final int partialFills;
+
+  /// Hits (counted in [hits]) served from such partially cached blocks
+  final int partialHits;
+
+  NfsCacheStats._(BlockCacheStats s)
+      : hits = s.hits,
+        misses = s.misses,
+        fetchClaims = s.fetch_claims,
+        dedupPresent = s.dedup_present,
+        dedupInflight = s.dedup_inflight,
+        fetchFailures = s.fetch_failures,
+        residentBytes = s.resident_bytes,
+        trimmedBytes = s.trimmed_bytes,
+        diskHits = s.disk_hits,
+        diskMisses = s.disk_misses,
+        diskWrites = s.disk_writes,
+        diskCorrupt = s.disk_corrupt,
+        compressedStores = s.compressed_stores,
+        compressedRejects = s.compressed_rejects,
+        compressedHits = s.compressed_hits,
+        compressedRawBytes = s.compressed_raw_bytes,
+        compressedStoredBytes = s.compressed_stored_bytes,
+        compressedResidentBytes = s.compressed_resident_bytes,
+        decompressNs = s.decompress_ns,
+        dirtyBytes = s.dirty_bytes,
+        absorbedWrites = s.absorbed_writes,
+        flushWrites = s.flush_writes,
+        flushedBytes = s.flushed_bytes,
+        deltaWrites = s.delta_writes,
+        deltaFallbacks = s.delta_fallbacks,
+        deltaBytesSent = s.delta_bytes_sent,
+        deltaBytesSaved = s.delta_bytes_saved,
+        dedupRefs = s.dedup_refs,
+        dedupUnique = s.dedup_unique,
+        dedupLogicalBytes = s.dedup_logical_bytes,
+        dedupStoredBytes = s.dedup_stored_bytes,
+        partialFills = s.partial_fills,
+        partialHits = s.partial_hits;
+
+  /// Fetches avoided by single-flight deduplication
+  int get deduplicatedFetches => dedupPresent + dedupInflight;
+
+  /// Average compression ratio of the blocks stored in the pool
+  double get compressionRatio => compressedStoredBytes == 0
+      ? 0.0
+      : compressedRawBytes / compressedStoredBytes;
+
+  /// Average time to decompress a pool hit, in microseconds
+  double get avgDecompressMicros =>
+      compressedHits == 0 ? 0.0 : decompressNs / compressedHits / 1000.0;
+
+  /// Share of delta-written bytes that did not have to be sent (0..1)
+  double get deltaSavedRatio {
+    final total = deltaBytesSent + deltaBytesSaved;
+    return total == 0 ? 0.0 : deltaBytesSaved / total;
+  }
+
+  /// Bytes held per byte of memory among deduplicated blocks; 1.0 when
+  /// nothing is shared
+  double get dedupRatio => dedupStoredBytes == 0
+      ? 1.0
+      : dedupLogicalBytes / dedupStoredBytes;
+
+  /// Share of lookups that hit only thanks to the compressed pool (0..1):
+  /// without it, these would have been misses
+  double get compressedHitGain {
+    final lookups = hits + misses;
+    return lookups == 0 ? 0.0 : compressedHits / lookups;
+  }
+}
+
+/// Counters of a Block Cache partition, see
+/// [NfsNativeClient.cachePartitionStats]
+class NfsCachePartitionStats {
+  /// Capacity reserved for the partition, in bytes
+  final int budgetBytes;
+
+  /// Cache memory its blocks hold, in bytes
+  final int residentBytes;
+
+  /// Of [residentBytes], what it holds beyond its budget
+  final int borrowedBytes;
+
+  /// Blocks of its files served from the cache
+  final int hits;
+
+  /// Reads of its files that stopped at a missing block
+  final int misses;
+
+  NfsCachePartitionStats._(CachePartitionStats s)
+      : budgetBytes = s.budget_bytes,
+        residentBytes = s.resident_bytes,
+        borrowedBytes = s.borrowed_bytes,
+        hits = s.hits,
+        misses = s.misses;
+
+  /// Share of lookups that hit (0..1)
+  double get hitRatio {
+    final lookups = hits + misses;
+    return lookups == 0 ? 0.0 : hits / lookups;
+  }
+}
+
+/// Native prefetch engine counters, see
+/// [NfsNativeClient.startNativePrefetch]
+class NfsPrefetchStats {
+  /// Blocks the VFS asked to prefetch
+  final int requests;
+
+  /// Of [requests], dropped because they were queued already
+  final int coalesced;
+
+  /// Of [requests], dropped because the queue was full
+  final int overflows;
+
+  /// Blocks read into the cache
+  final int fetched;
+
+  /// Queued blocks found cached, in flight or past EOF by their turn
+  final int skipped;
+
+  /// READs that failed
+  final int failed;
+
+  /// Bytes of the blocks fetched
+  final int fetchedBytes;
+
+  /// Time spent in those READs, in microseconds, summed though they overlap
+  final int fetchMicros;
+
+  /// Worker threads running; 0 when the engine is stopped
+  final int workers;
+
+  /// READs each worker keeps in flight
+  final int depth;
+
+  NfsPrefetchStats._(PrefetchStats s)
+      : requests = s.requests,
+        coalesced = s.coalesced,
+        overflows = s.overflows,
+        fetched = s.fetched,
+        skipped = s.skipped,
+        failed = s.failed,
+        fetchedBytes = s.fetched_bytes,
+        fetchMicros = s.fetch_us,
+        workers = s.workers,
+        depth = s.depth;
+
+  /// Average time of a prefetch READ, in microseconds
+  double get avgFetchMicros => fetched == 0 ? 0.0 : fetchMicros / fetched;
+}
+
+/// State of an [NfsCachePreload]. The index is the native state + 2.
+enum NfsPreloadState {
+  /// Preloading stopped by [NfsCachePreload.release].
+  cancelled,
+
+  /// Preloading failed; blocks loaded so far stay pinned until released.
+  failed,
+
+  /// Still loading.
+  running,
+
+  /// The whole range is cached and pinned.
+  done,
+}
+
+/// Handle of a Block Cache preload, see [NfsNativeClient.preloadCache]
+class NfsCachePreload {
+  final NfsBindings _bindings;
+  Pointer<Void> _handle;
+  int _doneBytes = 0;
+  int _totalBytes = 0;
+
+  NfsCachePreload._(this._bindings, this._handle);
+
+  /// Current state; also refreshes [doneBytes] and [totalBytes]
+  NfsPreloadState get state {
+    if (_handle == nullptr) return NfsPreloadState.cancelled;
+    final done = calloc<Uint64>();
+    final total = calloc<Uint64>();
+    try {
+      final state = _bindings.cache_preload_progress!(_handle, done, total);
+      _doneBytes = done.value;
+      _totalBytes = total.value;
+      return NfsPreloadState.values[state + 2];
+    } finally {
+      calloc.free(done);
+      calloc.free(total);
+    }
+  }
+
+  /// Bytes cached and pinned, as of the last [state] read
+  int get doneBytes => _doneBytes;
+
+  /// Size of the range clipped to EOF, as of the last [state] read; 0 until
+  /// the file has been opened
+  int get totalBytes => _totalBytes;
+
+  /// Completion between 0 and 1, as of the last [state] read
+  double get progress => _totalBytes == 0 ? 0.0 : _doneBytes / _totalBytes;
+
+  /// Completes with the final state once loading stops, polling every
+  /// [pollInterval]
+  Future<NfsPreloadState> whenDone(
+      {Duration pollInterval = const Duration(milliseconds: 50)}) async {
+    var current = state;
+    while (current == NfsPreloadState.running) {
+      await Future<void>.delayed(pollInterval);
+      current = state;
+    }
+    return current;
+  }
+
+  /// Stop loading if still running and unpin the blocks, letting them be
+  /// evicted again
+  void release() {
+    if (_handle == nullptr) return;
+    _bindings.cache_preload_release!(_handle);
+    _handle = nullptr;
+  }
+}
+
+/// Block Cache eviction policies. The index is the native policy id passed
+/// to `cache_init_with_policy`.
+enum NfsCacheEvictionPolicy {
+  /// Least recently used.
+  lru,
+
+  /// S3-FIFO: blocks read only once leave through a small probationary
+  /// queue, so scans do not displace the working set.
+  s3fifo,
+}
+
+/// How much [NfsNativeClient.trimCache] sheds. The index is the native
+/// trim level passed to `cache_trim`.
+enum NfsCacheTrimLevel {
+  /// Only return memory of slots that hold no block.
+  freeSlots,
+
+  /// Keep at most half of the cache capacity.
+  moderate,
+
+  /// Keep at most a quarter of the cache capacity.
+  low,
+
+  /// Drop every block that is not pinned or being fetched.
+  complete,
+}
@@ -14,21 +14,35 @@ class NfsFile {
   final Pointer<NfsContext> _context;
   final Pointer<NfsFh> _handle;
   final int _size;
+  final int _fileId;
   bool _isClosed = false;
 
+  /// Send only the ranges that differ from the cached copy on [pwrite], for
+  /// files rewritten in place such as savestates. The rest of the range
+  /// must have been read (or written) through the Block Cache recently;
+  /// otherwise the write is sent whole. Needs a [fileId].
+  bool deltaWrites = false;
+
   NfsFile({
     required NfsBindings bindings,
     required Pointer<NfsContext> context,
     required Pointer<NfsFh> handle,
     required int size,
+    int fileId = 0,
   })  : _bindings = bindings,
         _context = context,
         _handle = handle,
-        _size = size;
+        _size = size,
+        _fileId = fileId;
 
   /// File size in bytes
   int get size => _size;
 
+  /// Block cache identity of this file, derived from the server's
+  /// fsid/fileid. Matches the id the libretro VFS uses for the same file,
+  /// so both share cached blocks. 0 if the native cache is unavailable.
+  int get fileId => _fileId;
+
   /// Whether this file handle has been closed
   bool get isClosed => _isClosed;
 
@@ -84,6 +98,10 @@ class NfsFile {
   /// returns number of bytes written, or -1 on error.
   int pwrite(Pointer<Uint8> buffer, int count, int offset) {
     _ensureOpen();
+    final deltaPwrite = _bindings.nfs_delta_pwrite;
+    if (deltaWrites && _fileId != 0 && deltaPwrite != null) {
+      return deltaPwrite(_context, _handle, _fileId, buffer, count, offset);
+    }
     return _bindings.nfs_pwrite(_context, _handle, buffer, count, offset);
   }
 
@@ -2,10 +2,13 @@ import 'dart:async';
 import 'dart:ffi';
 import 'dart:isolate';
 import 'package:ffi/ffi.dart';
+import 'nfs_bindings.dart';
 import 'nfs_client.dart';
 import 'nfs_file.dart';
 
-/// Worker isolate for NFS prefetching and cache maintenance
+/// Worker isolate for NFS prefetching and cache maintenance. The native
+/// engine ([NfsNativeClient.startNativePrefetch]) avoids the isolate round
+/// trip; while it runs, the VFS does not call this worker.
 class NfsWorker {
   SendPort? _sendPort;
   Isolate? _isolate;
@@ -88,8 +91,15 @@ class NfsWorker {
         _prefetchBlocks(blockId, client!, file!, buffer!, blockSize, fileSize);
       });
 
-      // Register callback with C++ layer
-      if (client.bindings.nfs_set_prefetch_callback != null) {
+      // Register callback with C++ layer, scoped to this file when supported
+      // so several workers can stream different files at once.
+      if (client.bindings.nfs_register_prefetch_callback != null &&
+          file.fileId != 0) {
+        client.bindings.nfs_register_prefetch_callback!(
+            file.fileId, prefetchCallback.nativeFunction);
+        print('[NfsWorker] Prefetch callback registered for file '
+            '${file.fileId.toRadixString(16)}');
+      } else if (client.bindings.nfs_set_prefetch_callback != null) {
         client.bindings
             .nfs_set_prefetch_callback!(prefetchCallback.nativeFunction);
         print('[NfsWorker] Prefetch callback registered');
@@ -102,7 +112,11 @@ class NfsWorker {
         if (msg is Map) {
           if (msg['cmd'] == 'stop') {
             if (prefetchCallback != null) {
-              // Unregister? optional
+              final fileId = file?.fileId ?? 0;
+              if (fileId != 0) {
+                client?.bindings.nfs_register_prefetch_callback
+                    ?.call(fileId, nullptr);
+              }
               prefetchCallback.close();
             }
             port.close();
@@ -124,31 +138,57 @@ class NfsWorker {
 
   static void _prefetchBlocks(int startBlockId, NfsNativeClient client,
       NfsFile file, Pointer<Uint8> buffer, int blockSize, int fileSize) {
-    if (client.bindings.cache_has_block == null ||
-        client.bindings.cache_put == null) {
+    final claim = client.bindings.cache_file_claim;
+    final complete = client.bindings.cache_file_complete;
+    final fail = client.bindings.cache_file_fail;
+    final claimBuffer = client.bindings.cache_file_claim_buffer;
+    final commit = client.bindings.cache_file_commit;
+    if (claim == null || complete == null || fail == null) {
       return;
     }
+    final fileId = file.fileId;
+
+    // The cache tracks EOF across writers and short reads; the size seen at
+    // open is only a fallback.
+    final cachedSize = client.bindings.cache_file_size?.call(fileId) ?? -1;
+    final eof = cachedSize >= 0 ? cachedSize : fileSize;
 
     // Prefetch this block and next 2 blocks
     for (int i = 0; i < 3; i++) {
       int targetBlock = startBlockId + i;
 
-      if (client.bindings.cache_has_block!(targetBlock) != 0) {
-        continue; // Already in cache
+      // Never issue READs past EOF
+      int targetOffset = targetBlock * blockSize;
+      if (targetOffset >= eof) break;
+
+      // Cached, or someone else (VFS sync read, earlier callback) is
+      // already fetching it.
+      if (claim(fileId, targetBlock) != CACHE_CLAIMED) {
+        continue;
       }
 
-      int targetOffset = targetBlock * blockSize;
-      if (targetOffset >= fileSize) break;
+      int readSize =
+          (targetOffset + blockSize > eof) ? eof - targetOffset : blockSize;
 
-      int readSize = (targetOffset + blockSize > fileSize)
-          ? fileSize - targetOffset
-          : blockSize;
+      // READ straight into the slot claim_block reserved, if there is one:
+      // it stays invisible to readers until committed
+      final slot = claimBuffer?.call(fileId, targetBlock) ?? nullptr;
 
       // Read from NFS (Blocking call in this isolate)
-      int bytes = file.pread(buffer, readSize, targetOffset);
+      int bytes =
+          file.pread(slot != nullptr ? slot : buffer, readSize, targetOffset);
       if (bytes > 0) {
-        // Push to shared C++ Cache
-        client.bindings.cache_put!(targetBlock, buffer, bytes);
+        // Publish to shared C++ Cache and wake any waiting readers
+        if (slot != nullptr) {
+          commit!(fileId, targetBlock, bytes);
+        } else {
+          complete(fileId, targetBlock, buffer, bytes);
+        }
+        // Short read: the file ends here (complete recorded the new EOF)
+        if (bytes < readSize) break;
+      } else {
+        fail(fileId, targetBlock);
+        break;
       }
     }
   }
@@ -0,0 +1,124 @@
+#include "access_pattern.hpp"
+#include <algorithm>
+
+uint64_t AccessPattern::Stream::predict(uint64_t k) const {
+    switch (kind) {
+        case kSequential:
+            return last + k;
+        case kReverse:
+            return first >= k ? first - k : UINT64_MAX;
+        case kStride: {
+            int64_t target = (int64_t)first + stride * (int64_t)k;
+            return target >= 0 ? (uint64_t)target : UINT64_MAX;
+        }
+        default:
+            return UINT64_MAX;
+    }
+}
+
+// Blocks between two runs; 0 when they overlap or touch
+static uint64_t gap(uint64_t first, uint64_t last, const AccessPattern::Stream& s) {
+    if (first > s.last) return first - s.last;
+    if (s.first > last) return s.first - last;
+    return 0;
+}
+
+const AccessPattern::Stream& AccessPattern::observe(uint64_t first, uint64_t last, uint32_t max_window) {
+    ++clock_;
+    if (max_window == 0) max_window = 1;
+
+    // The stride stream this access was predicted by, else the nearest one
+    int best = -1;
+    uint64_t best_gap = UINT64_MAX;
+    for (int i = 0; i < kMaxStreams; ++i) {
+        const Stream& s = streams_[i];
+        if (!s.active) continue;
+        if (s.kind == kStride && (int64_t)(first - s.first) == s.stride) {
+            best = i;
+            break;
+        }
+        uint64_t g = gap(first, last, s);
+        if (g <= (uint64_t)kMaxStride && g < best_gap) {
+            best = i;
+            best_gap = g;
+        }
+    }
+
+    if (best < 0) {
+        // Start a stream in a free entry, else in the least recently used
+        int victim = 0;
+        for (int i = 0; i < kMaxStreams; ++i) {
+            if (!streams_[i].active) {
+                victim = i;
+                break;
+            }
+            if (streams_[i].used < streams_[victim].used) victim = i;
+        }
+        Stream& s = streams_[victim];
+        s = Stream();
+        s.first = first;
+        s.last = last;
+        s.used = clock_;
+        s.active = true;
+        return s;
+    }
+
+    Stream& s = streams_[best];
+    s.used = clock_;
+    s.issue_count = 0;
+    // Small reads within the same blocks say nothing about direction
+    if (first == s.first && last == s.last) return s;
+
+    Kind kind;
+    int64_t stride = 0;
+    int64_t steps = 1; // moved along the stream
+    if (first >= s.first && first <= s.last + 1 && last >= s.last) {
+        kind = kSequential;
+        steps = (int64_t)(last - s.last);
+    } else if (last <= s.last && last + 1 >= s.first && first <= s.first) {
+        kind = kReverse;
+        steps = (int64_t)(s.first - first);
+    } else {
+        kind = kStride;
+        stride = (int64_t)(first - s.first);
+    }
+
+    if (kind == s.kind && stride == s.stride) {
+        if (s.hits < INT32_MAX) ++s.hits;
+        s.ahead -= steps;
+        s.marker -= steps;
+    } else {
+        // A seek, or a change of direction: start over
+        s.kind = kind;
+        s.stride = stride;
+        s.hits = 1;
+        s.window = 0;
+    }
+    s.first = first;
+    s.last = last;
+    if (!s.confirmed()) return s;
+
+    if (s.window == 0 || s.ahead <= 0) {
+        // New stream, collapsed window, or the reader overtook it: start
+        // small right after this access, and refill on the next move
+        s.window = std::min(kInitialWindow, max_window);
+        s.issue_from = 1;
+        s.issue_count = s.window;
+        s.ahead = s.window;
+        s.marker = 1;
+    } else if (s.marker <= 0) {
+        // The reader reached the latest window: issue the next one, larger
+        s.window = std::min(s.window * 2, max_window);
+        s.issue_from = (uint64_t)s.ahead + 1;
+        s.issue_count = s.window;
+        s.marker = s.ahead + 1;
+        s.ahead += s.window;
+    }
+    return s;
+}
+
+void AccessPattern::miss(uint64_t block) {
+    for (Stream& s : streams_) {
+        if (s.active && gap(block, block, s) == 0) s.window = 0;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef ACCESS_PATTERN_HPP
+#define ACCESS_PATTERN_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Access streams of one file handle, at block granularity. A reader may
+// interleave several, e.g. a disc core alternating between its data and
+// audio tracks; each is classified as sequential, reverse or fixed-stride
+// once consecutive accesses agree. Readahead follows confirmed streams only,
+// so random access costs no bandwidth.
+//
+// Each confirmed stream carries an on-demand readahead window, counted in
+// steps along the stream (blocks, or accesses for strided streams). It starts
+// at kInitialWindow; when the reader crosses the marker at the start of the
+// latest window the next one is issued, twice as large up to the caller's
+// maximum. A miss or a seek collapses it back. Not thread-safe: one per
+// handle.
+class AccessPattern {
+public:
+    enum Kind {
+        kRandom = 0,
+        kSequential = 1,
+        kReverse = 2,
+        kStride = 3,
+    };
+
+    struct Stream {
+        uint64_t first = 0;   // blocks of its latest access
+        uint64_t last = 0;
+        int64_t stride = 0;   // kStride: blocks between consecutive accesses
+        Kind kind = kRandom;
+        int hits = 0;         // consecutive moves agreeing with kind
+        uint64_t used = 0;    // when last matched, for replacement
+        bool active = false;
+        uint32_t window = 0;  // size of the latest window; 0: none issued
+        int64_t ahead = 0;    // steps issued beyond the current access
+        int64_t marker = 0;   // steps to the marker; crossing it refills
+        // Steps to prefetch for the access just observed:
+        // predict(issue_from) onwards, issue_count of them
+        uint64_t issue_from = 0;
+        uint32_t issue_count = 0;
+
+        bool confirmed() const { return kind != kRandom && hits >= kConfirmHits; }
+        // Block the stream is expected to reach k accesses (k >= 1) from
+        // now: the end of the next run for sequential streams, the start of
+        // it otherwise. UINT64_MAX before block 0.
+        uint64_t predict(uint64_t k) const;
+    };
+
+    static constexpr int kMaxStreams = 4;
+    static constexpr int kConfirmHits = 2;
+    // Farther jumps than this many blocks start a new stream
+    static constexpr int64_t kMaxStride = 64;
+    static constexpr uint32_t kInitialWindow = 2;
+
+    // Record an access to blocks [first, last] and return the stream it
+    // joined, or started when it matches none, with the readahead it is due;
+    // windows grow to at most max_window steps
+    const Stream& observe(uint64_t first, uint64_t last, uint32_t max_window = kInitialWindow);
+
+    // The reader had to fetch block itself: collapse the window of its stream
+    void miss(uint64_t block);
+
+private:
+    Stream streams_[kMaxStreams];
+    uint64_t clock_ = 0;
+};
+
+#endif // ACCESS_PATTERN_HPP
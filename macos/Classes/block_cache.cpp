@@ -1,138 +1,1650 @@
 #include "block_cache.hpp"
+#include "hash64.hpp"
 #include <iostream>
 #include <algorithm>
 #include <cstring>
+#include <chrono>
+#include <thread>
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
 
 BlockCache& BlockCache::instance() {
     static BlockCache instance;
     return instance;
 }
 
-void BlockCache::init(size_t capacity_mb) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
+void BlockCache::init(size_t capacity_mb, EvictionPolicyType policy) {
     // Default to 64MB if 0 passed
     if (capacity_mb <= 0) capacity_mb = 64;
-    
+
+    std::unique_lock<std::mutex> lock(init_mutex_);
+    if (capacity_slots_ != 0) {
+        lock.unlock();
+        resize(capacity_mb);
+        return;
+    }
+
     size_t new_slots = (capacity_mb * 1024 * 1024) / BLOCK_SIZE;
     
-    if (slots_.empty()) {
-        slots_.reserve(new_slots);
-        for (size_t i = 0; i < new_slots; ++i) {
-            slots_.push_back(std::make_unique<Slot>());
+    if (new_slots > 0) {
+        // Use as many shards as possible while keeping each one big enough
+        // for the per-shard policy order to approximate a global one.
+        uint32_t shards = 1;
+        while (shards < kMaxShards && new_slots / (shards * 2) >= kMinSlotsPerShard) {
+            shards *= 2;
+        }
+
+        policy_type_ = policy;
+        for (uint32_t i = 0; i < shards; ++i) {
+            size_t slots = new_slots / shards + (i < new_slots % shards ? 1 : 0);
+            std::lock_guard<std::mutex> shard_lock(shards_[i].mutex);
+            configure_partitions(shards_[i], new_slots);
+            shards_[i].dedup = &dedup_;
+            shards_[i].init(slots, policy);
+            shards_[i].compressed.set_budget(compressed_budget_ / shards);
         }
+        shard_count_.store(shards, std::memory_order_relaxed);
         capacity_slots_ = new_slots;
-         std::cout << "[BlockCache] Initialized with " << capacity_slots_ << " slots ("
-                   << capacity_mb << " MB)" << std::endl;
+         std::cout << "[BlockCache] Initialized with " << new_slots << " slots ("
+                   << capacity_mb << " MB, " << shards << " shards, "
+                   << EvictionPolicy::name(policy) << ")" << std::endl;
     }
 }
 
-int BlockCache::evict_lru() {
-    int victim_idx = -1;
-    uint64_t min_access = UINT64_MAX;
+bool BlockCache::resize(size_t capacity_mb) {
+    std::lock_guard<std::mutex> lock(init_mutex_);
+    size_t new_slots = (capacity_mb * 1024 * 1024) / BLOCK_SIZE;
+    if (capacity_slots_ == 0 || new_slots == 0) return false;
+
+    // Shards keep their count; each takes an even share of the new capacity
+    uint32_t shards = shard_count_.load(std::memory_order_relaxed);
+    size_t released = 0;
+    size_t shared_before = dedup_.committed_bytes();
+    for (uint32_t i = 0; i < shards; ++i) {
+        size_t slots = new_slots / shards + (i < new_slots % shards ? 1 : 0);
+        std::lock_guard<std::mutex> shard_lock(shards_[i].mutex);
+        configure_partitions(shards_[i], new_slots);
+        released += shards_[i].resize(std::max<size_t>(slots, 1));
+    }
+    released += shared_before - std::min(shared_before, dedup_.committed_bytes());
+    size_t old_slots = capacity_slots_.exchange(new_slots);
+    std::cout << "[BlockCache] Resized from " << old_slots << " to " << new_slots
+              << " slots (" << capacity_mb << " MB, released " << released / (1024 * 1024)
+              << " MB)" << std::endl;
+    return true;
+}
 
-    // 1. Look for invalid (empty) slots first
-    for (size_t i = 0; i < slots_.size(); ++i) {
-        if (!slots_[i]->valid) return i;
+int BlockCache::create_partition(const std::string& name, size_t capacity_mb, bool borrow) {
+    if (name.empty()) return -1;
+    std::lock_guard<std::mutex> lock(init_mutex_);
+    int id = -1;
+    for (int i = 1; i < kMaxPartitions && id < 0; ++i) {
+        if (partitions_[i].used && partitions_[i].name == name) id = i;
+    }
+    for (int i = 1; i < kMaxPartitions && id < 0; ++i) {
+        if (!partitions_[i].used) id = i;
     }
+    if (id < 0) return -1;
 
-    // 2. Find LRU
-    for (size_t i = 0; i < slots_.size(); ++i) {
-        if (slots_[i]->last_access < min_access) {
-            min_access = slots_[i]->last_access;
-            victim_idx = i;
+    PartitionConfig& cfg = partitions_[id];
+    cfg.name = name;
+    cfg.capacity_mb = capacity_mb;
+    cfg.borrow = borrow;
+    cfg.used = true;
+    size_t slots = capacity_slots_.load(std::memory_order_relaxed);
+    if (slots != 0) {
+        // Budgets apply lazily: a partition over its new budget loses
+        // blocks as others need room
+        uint32_t shards = shard_count_.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < shards; ++i) {
+            std::lock_guard<std::mutex> shard_lock(shards_[i].mutex);
+            configure_partitions(shards_[i], slots);
+            shards_[i].rebudget();
         }
     }
-    
-    if (victim_idx != -1) {
-        // Remove old mapping
-        id_to_slot_.erase(slots_[victim_idx]->block_id);
-        slots_[victim_idx]->valid = false;
+    std::cout << "[BlockCache] Partition " << id << " '" << name << "': " << capacity_mb << " MB"
+              << (borrow ? ", borrowing" : "") << std::endl;
+    return id;
+}
+
+void BlockCache::configure_partitions(Shard& shard, size_t total_slots) {
+    size_t named = 0;
+    for (int i = 1; i < kMaxPartitions; ++i) {
+        if (partitions_[i].used) named += partitions_[i].capacity_mb * 1024 * 1024 / BLOCK_SIZE;
+    }
+    // Oversubscribed budgets are scaled down to fit the capacity
+    double scale = named > total_slots ? (double)total_slots / named : 1.0;
+    for (int i = 1; i < kMaxPartitions; ++i) {
+        const PartitionConfig& cfg = partitions_[i];
+        if (!cfg.used) continue;
+        ShardPartition& part = shard.parts[i];
+        if (!part.policy) part.policy = EvictionPolicy::create(policy_type_, 0);
+        part.share = (double)(cfg.capacity_mb * 1024 * 1024 / BLOCK_SIZE) * scale / total_slots;
+        part.borrow = cfg.borrow;
     }
-    return victim_idx;
 }
 
-void BlockCache::put_block(uint64_t block_id, const uint8_t* data, size_t len) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    if (id_to_slot_.count(block_id)) {
-        // Block already present. We don't overwrite for performance
-        // (assuming read-only ROM usage).
-        return; 
+void BlockCache::set_file_partition(uint64_t file_id, int partition) {
+    if (partition < 0 || partition >= kMaxPartitions) partition = 0;
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    files_[file_id].partition = static_cast<uint32_t>(partition);
+}
+
+bool BlockCache::partition_stats(int partition, CachePartitionStats* out) {
+    if (partition < 0 || partition >= kMaxPartitions) return false;
+    std::lock_guard<std::mutex> lock(init_mutex_);
+    if (partition != 0 && !partitions_[partition].used) return false;
+
+    size_t budget = 0, live = 0, borrowed = 0;
+    uint32_t shards = shard_count_.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < shards; ++i) {
+        std::lock_guard<std::mutex> shard_lock(shards_[i].mutex);
+        const ShardPartition& part = shards_[i].parts[partition];
+        budget += part.budget;
+        live += part.live;
+        if (part.live > part.budget) borrowed += part.live - part.budget;
+    }
+    out->budget_bytes = budget * BLOCK_SIZE;
+    out->resident_bytes = live * BLOCK_SIZE;
+    out->borrowed_bytes = borrowed * BLOCK_SIZE;
+    out->hits = partition_counters_[partition].hits.load(std::memory_order_relaxed);
+    out->misses = partition_counters_[partition].misses.load(std::memory_order_relaxed);
+    return true;
+}
+
+size_t BlockCache::capacity_mb() const {
+    return capacity_slots_.load() * BLOCK_SIZE / (1024 * 1024);
+}
+
+uint64_t BlockCache::make_file_id(uint64_t fsid, uint64_t fileid) {
+    // splitmix64 finalizer over both halves of the identity
+    uint64_t h = fsid * 0x9E3779B97F4A7C15ULL ^ fileid;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h != 0 ? h : 1;
+}
+
+// --- Shard ---
+
+void BlockCache::Shard::init(size_t slots, EvictionPolicyType policy_type) {
+    parts[0].policy = EvictionPolicy::create(policy_type, 0);
+    resize(slots);
+}
+
+void BlockCache::Shard::rebudget() {
+    size_t named = 0;
+    for (int i = 1; i < kMaxPartitions; ++i) {
+        ShardPartition& part = parts[i];
+        if (!part.policy) continue;
+        part.budget = std::min(capacity, std::max<size_t>(1, (size_t)(capacity * part.share)));
+        named += part.budget;
+    }
+    parts[0].budget = capacity > named ? capacity - named : 0;
+    for (ShardPartition& part : parts) {
+        if (part.policy) part.policy->resize(meta.size(), std::max<size_t>(part.budget, 1));
+    }
+}
+
+size_t BlockCache::Shard::resize(size_t slots) {
+    capacity = slots;
+    if (slots > meta.size()) {
+        size_t old = meta.size();
+        meta.resize(slots);
+        arena.reserve(slots);
+        // Push in reverse so the lowest new slot is handed out first
+        for (size_t i = slots; i > old; --i) {
+            free_slots.push_back(static_cast<uint32_t>(i - 1));
+        }
+        key_to_slot.reserve(slots);
+    }
+    rebudget();
+    return shed(capacity, true);
+}
+
+size_t BlockCache::Shard::shed(size_t target, bool keep_refillable) {
+    size_t committed = arena.committed_bytes();
+    while (live() > target && evict_one()) {}
+    // acquire_slot pops from the back, so keep the back and release the front
+    size_t keep = keep_refillable && capacity > live() ? capacity - live() : 0;
+    for (size_t i = 0; i + keep < free_slots.size(); ++i) {
+        arena.release(free_slots[i]);
+    }
+    return committed - arena.committed_bytes();
+}
+
+uint32_t BlockCache::Shard::acquire_slot(uint32_t partition) {
+    if (partition >= kMaxPartitions || !parts[partition].policy) partition = 0;
+    ShardPartition& part = parts[partition];
+
+    // 1. Reuse a free slot while under capacity; past its budget only if
+    //    the partition may borrow
+    if (live() < capacity && !free_slots.empty() && (part.live < part.budget || part.borrow)) {
+        uint32_t slot = free_slots.back();
+        if (arena.slot(slot) == nullptr) return kNil; // could not map memory
+        free_slots.pop_back();
+        meta[slot].partition = static_cast<uint8_t>(partition);
+        part.live++;
+        return slot;
+    }
+
+    // 2. Evict a victim. Over capacity after a shrink, shed extra blocks
+    //    first so the cache converges to its new size.
+    while (live() > capacity && evict_one()) {}
+    uint32_t victim = pick_victim(partition);
+    if (victim == kNil) return kNil; // capacity 0, or everything pinned / loading
+
+    SlotMeta& m = meta[victim];
+    if (compressed.enabled() && m.pages == kAllPages && m.valid_len > 0) {
+        // Copy only; compressing under the lock would stall the shard
+        Evicted e = {m.key, m.generation, m.valid_len, std::unique_ptr<uint8_t[]>(new uint8_t[m.valid_len])};
+        std::memcpy(e.data.get(), payload(victim), m.valid_len);
+        evicted.push_back(std::move(e));
+        evicted_count.store(evicted.size(), std::memory_order_relaxed);
+    }
+    key_to_slot.erase(m.key);
+    m.valid = false;
+    unshare(victim);
+    if (arena.slot(victim) == nullptr) { // a shared block's slot may be unmapped
+        release_slot(victim);
+        return kNil;
+    }
+    parts[m.partition].live--;
+    m.partition = static_cast<uint8_t>(partition);
+    part.live++;
+    return victim;
+}
+
+uint32_t BlockCache::Shard::pick_victim(uint32_t partition) {
+    ShardPartition& part = parts[partition];
+    bool under_budget = part.live < part.budget;
+    uint32_t victim = kNil;
+    // Under its budget, a partition first takes back what others borrowed
+    if (under_budget) victim = pick_from_largest(true);
+    if (victim == kNil) victim = part.policy->pick_victim();
+    // Its own blocks are all busy: a borrower may take others' surplus
+    if (victim == kNil && !under_budget && part.borrow) victim = pick_from_largest(true);
+    return victim;
+}
+
+uint32_t BlockCache::Shard::pick_from_largest(bool beyond_budget) {
+    bool tried[kMaxPartitions] = {};
+    for (;;) {
+        int best = -1;
+        size_t best_size = 0;
+        for (int i = 0; i < kMaxPartitions; ++i) {
+            const ShardPartition& part = parts[i];
+            if (!part.policy || tried[i]) continue;
+            size_t size = part.live;
+            if (beyond_budget) size = part.live > part.budget ? part.live - part.budget : 0;
+            if (size > best_size) {
+                best = i;
+                best_size = size;
+            }
+        }
+        if (best < 0) return kNil;
+        uint32_t victim = parts[best].policy->pick_victim();
+        if (victim != kNil) return victim;
+        tried[best] = true; // all pinned, loading or dirty
+    }
+}
+
+uint32_t BlockCache::Shard::promote(const BlockKey& key, uint32_t partition) {
+    if (key_to_slot.count(key) != 0) return kNil;
+    // Detach before acquiring, so the slot's victim, bound for the pool
+    // too, cannot push key out of it
+    CompressedPool::Blob blob;
+    if (!compressed.take(key, &blob)) return kNil;
+    uint32_t slot = acquire_slot(partition);
+    if (slot == kNil) return kNil;
+    int len = compressed.decompress(blob, payload(slot));
+    if (len < 0) {
+        release_slot(slot);
+        return kNil;
+    }
+
+    SlotMeta& m = meta[slot];
+    m.key = key;
+    m.valid = true;
+    m.loading = false;
+    m.retired = false;
+    m.valid_len = static_cast<uint32_t>(len);
+    m.pages = kAllPages;
+    m.generation = blob.generation;
+    key_to_slot[key] = slot;
+    policy_of(slot)->on_insert(slot, BlockKeyHash()(key));
+    notify(key);
+    return slot;
+}
+
+void BlockCache::Shard::expire(const BlockKey& key, uint32_t generation) {
+    compressed.erase_stale(key, generation);
+    auto it = key_to_slot.find(key);
+    if (it == key_to_slot.end()) return;
+    SlotMeta& m = meta[it->second];
+    if (m.generation == generation) return;
+    if (m.dirty) {
+        m.generation = generation;
+    } else {
+        drop(key);
+    }
+}
+
+bool BlockCache::Shard::drop(const BlockKey& key) {
+    bool pooled = compressed.erase(key);
+    auto it = key_to_slot.find(key);
+    if (it == key_to_slot.end()) return pooled;
+    SlotMeta& m = meta[it->second];
+    if (m.loading) {
+        // Keep the claim mapped so the fetcher's completion is discarded
+        m.retired = true;
+        return true;
+    }
+    if (m.pins > 0) {
+        // Readers still hold the old contents; free the slot on last unpin
+        m.valid = false;
+        m.retired = true;
+    } else {
+        release_slot(it->second);
+    }
+    key_to_slot.erase(it);
+    return true;
+}
+
+bool BlockCache::Shard::evict_one() {
+    // Shrinking: borrowed slots go first, then the biggest partition's
+    uint32_t victim = pick_from_largest(true);
+    if (victim == kNil) victim = pick_from_largest(false);
+    if (victim == kNil) return false;
+    key_to_slot.erase(meta[victim].key);
+    release_slot(victim);
+    return true;
+}
+
+void BlockCache::Shard::release_slot(uint32_t slot) {
+    policy_of(slot)->on_remove(slot);
+    unshare(slot);
+    parts[meta[slot].partition].live--;
+    meta[slot].valid = false;
+    meta[slot].filling = false;
+    if (meta[slot].dirty) {
+        meta[slot].dirty = false;
+        dirty_blocks.fetch_sub(1, std::memory_order_relaxed);
+    }
+    free_slots.push_back(slot);
+    // Surplus after a shrink (e.g. was pinned at the time): nothing refills it
+    if (live() >= capacity) arena.release(slot);
+}
+
+void BlockCache::SharedPayload::acquire(const uint8_t* data, size_t len) {
+    if (id_ != DedupStore::kNil || len == 0 || !store_.enabled()) return;
+    id_ = store_.acquire(hash64(data, len), data, len, &data_);
+}
+
+bool BlockCache::Shard::share(uint32_t slot, SharedPayload& payload) {
+    if (payload.id_ == DedupStore::kNil) return false;
+    unshare(slot);
+    meta[slot].shared = payload.id_;
+    meta[slot].shared_data = payload.data_;
+    payload.id_ = DedupStore::kNil;
+    arena.release(slot);
+    return true;
+}
+
+uint8_t* BlockCache::Shard::make_private(uint32_t slot) {
+    SlotMeta& m = meta[slot];
+    // Pin holders read the shared payload in place: it must stay referenced
+    if (m.shared_data && m.pins > 0) return nullptr;
+    uint8_t* mem = arena.slot(slot);
+    if (!m.shared_data || !mem) return mem;
+    std::memcpy(mem, m.shared_data, m.valid_len);
+    unshare(slot);
+    return mem;
+}
+
+void BlockCache::Shard::unshare(uint32_t slot) {
+    SlotMeta& m = meta[slot];
+    if (!m.shared_data) return;
+    dedup->release(m.shared);
+    m.shared = DedupStore::kNil;
+    m.shared_data = nullptr;
+}
+
+uint32_t BlockCache::Shard::find_ready(const BlockKey& key) const {
+    auto it = key_to_slot.find(key);
+    if (it == key_to_slot.end() || !meta[it->second].valid || meta[it->second].pages != kAllPages) return kNil;
+    return it->second;
+}
+
+uint32_t BlockCache::Shard::find_partial(const BlockKey& key) const {
+    auto it = key_to_slot.find(key);
+    if (it == key_to_slot.end() || !meta[it->second].valid || meta[it->second].pages == kAllPages) return kNil;
+    return it->second;
+}
+
+size_t BlockCache::Shard::held_bytes(uint32_t slot, size_t from, size_t want) const {
+    const SlotMeta& m = meta[slot];
+    size_t end = std::min<size_t>(from + want, m.valid_len);
+    size_t pos = from;
+    while (pos < end && (m.pages >> (pos / SUB_BLOCK_SIZE)) & 1) {
+        pos = (pos / SUB_BLOCK_SIZE + 1) * SUB_BLOCK_SIZE;
+    }
+    return pos > from ? std::min(pos, end) - from : 0;
+}
+
+uint32_t BlockCache::Shard::find_current(const BlockKey& key, uint64_t eof) const {
+    uint32_t slot = find_ready(key);
+    // A short block ending before EOF was cached before the file grew
+    if (slot != kNil && meta[slot].valid_len < BLOCK_SIZE &&
+        key.block_id * BLOCK_SIZE + meta[slot].valid_len < eof) {
+        return kNil;
+    }
+    return slot;
+}
+
+bool BlockCache::Shard::is_loading(const BlockKey& key) const {
+    auto it = key_to_slot.find(key);
+    return it != key_to_slot.end() && meta[it->second].loading;
+}
+
+void BlockCache::Shard::notify(const BlockKey& key) {
+    publish_seq.fetch_add(1, std::memory_order_release);
+    auto it = waiters.find(key);
+    if (it != waiters.end()) it->second->cv.notify_all();
+}
+
+void BlockCache::Shard::pin(uint32_t slot) {
+    if (meta[slot].pins++ == 0) {
+        policy_of(slot)->on_remove(slot);
+        pinned_slots.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void BlockCache::Shard::unpin(uint32_t slot) {
+    SlotMeta& m = meta[slot];
+    if (--m.pins > 0) return;
+    pinned_slots.fetch_sub(1, std::memory_order_relaxed);
+    if (m.retired) {
+        m.retired = false;
+        release_slot(slot);
+    } else if (!m.dirty) {
+        policy_of(slot)->on_reinsert(slot);
+    }
+}
+
+// --- Pin ---
+
+BlockCache::Pin& BlockCache::Pin::operator=(Pin&& other) noexcept {
+    if (this != &other) {
+        reset();
+        shard_ = other.shard_;
+        slot_ = other.slot_;
+        data_ = other.data_;
+        size_ = other.size_;
+        other.shard_ = nullptr;
+        other.data_ = nullptr;
+    }
+    return *this;
+}
+
+void BlockCache::Pin::reset() {
+    if (!shard_) return;
+    {
+        std::lock_guard<std::mutex> lock(shard_->mutex);
+        shard_->unpin(slot_);
+    }
+    shard_ = nullptr;
+    slot_ = kNil;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+// --- BlockCache ---
+
+void BlockCache::compress_evicted(Shard& shard) {
+    std::vector<Shard::Evicted> batch;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        batch.swap(shard.evicted);
+        shard.evicted_count.store(0, std::memory_order_relaxed);
+    }
+    if (batch.empty()) return;
+
+    std::vector<CompressedPool::Blob> blobs(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const Shard::Evicted& e = batch[i];
+        // Invalidated since: not worth compressing
+        if (file_generation(e.key.file_id) != e.generation) {
+            batch[i].data.reset();
+            continue;
+        }
+        CompressedPool::compress(e.generation, e.data.get(), e.len, &blobs[i]);
     }
 
-    int slot_idx = evict_lru();
-    if (slot_idx == -1) {
-        // Should happen only if capacity 0
-        return; 
+    // Re-check under the lock: a block refetched meanwhile lives in its slot
+    // instead. A blob invalidated after the check above is dropped by expire.
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (!batch[i].data) continue; // stale
+        if (shard.key_to_slot.count(batch[i].key) != 0) continue;
+        shard.compressed.insert(batch[i].key, std::move(blobs[i]));
     }
+}
+
+void BlockCache::put_block(uint64_t file_id, uint64_t block_id, const uint8_t* data, size_t len) {
+    complete_block(file_id, block_id, data, len);
+}
+
+BlockCache::ClaimResult BlockCache::claim_block(uint64_t file_id, uint64_t block_id) {
+    uint32_t partition = 0;
+    uint32_t generation = file_generation(file_id, nullptr, &partition);
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    EvictedFlush flush(*this, shard);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.expire(key, generation);
 
-    Slot* slot = slots_[slot_idx].get();
+    // A partial block is fetched whole, replacing what it holds
+    if (shard.find_partial(key) != kNil) shard.drop(key);
+    auto it = shard.key_to_slot.find(key);
+    if (it != shard.key_to_slot.end()) {
+        if (shard.meta[it->second].valid) {
+            counters_.dedup_present.fetch_add(1, std::memory_order_relaxed);
+            return kPresent;
+        }
+        counters_.dedup_inflight.fetch_add(1, std::memory_order_relaxed);
+        return kInFlight;
+    }
+    if (shard.promote(key, partition) != kNil) {
+        counters_.dedup_present.fetch_add(1, std::memory_order_relaxed);
+        return kPresent;
+    }
+
+    // Reserve the slot now so concurrent claimants see the fetch in flight.
+    // With no slot to spare (everything pinned or loading) the claim is
+    // still granted, just not deduplicated.
+    uint32_t slot_idx = shard.acquire_slot(partition);
+    if (slot_idx != kNil) {
+        SlotMeta& m = shard.meta[slot_idx];
+        m.key = key;
+        m.valid = false;
+        m.loading = true;
+        m.claimed_at = std::chrono::steady_clock::now();
+        m.generation = generation;
+        shard.key_to_slot[key] = slot_idx;
+    }
+    lock.unlock();
+
+    // A disk tier hit fills the reserved slot; no network fetch needed
+    if (load_from_disk(key)) return kPresent;
+
+    counters_.fetch_claims.fetch_add(1, std::memory_order_relaxed);
+    return kClaimed;
+}
+
+void BlockCache::complete_block(uint64_t file_id, uint64_t block_id, const uint8_t* data, size_t len) {
+    publish(file_id, block_id, data, len, true);
+}
+
+void BlockCache::publish(uint64_t file_id, uint64_t block_id, const uint8_t* data, size_t len, bool persist) {
+    uint32_t partition = 0;
+    uint32_t generation = file_generation(file_id, nullptr, &partition);
     size_t copy_len = std::min(len, BLOCK_SIZE);
-    
-    if (data != nullptr) {
-        std::memcpy(slot->data, data, copy_len);
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    // Find or add the shared copy before taking the lock for good, unless
+    // the block is complete already. Dropped again if it turns out unused.
+    SharedPayload shared(dedup_);
+    if (data != nullptr && dedup_.enabled()) {
+        bool present = false;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.expire(key, generation);
+            auto it = shard.key_to_slot.find(key);
+            present = it != shard.key_to_slot.end() && !shard.meta[it->second].loading &&
+                      shard.meta[it->second].pages == kAllPages;
+        }
+        if (!present) shared.acquire(data, copy_len);
     }
+    EvictedFlush flush(*this, shard);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    // A claim from before an invalidation is retired here, dropping its data
+    shard.expire(key, generation);
     
-    // Zero fill padding if short read
-    if (copy_len < BLOCK_SIZE) {
-        std::memset(slot->data + copy_len, 0, BLOCK_SIZE - copy_len);
+    uint32_t slot_idx = kNil;
+    auto it = shard.key_to_slot.find(key);
+    if (it != shard.key_to_slot.end()) {
+        SlotMeta& m = shard.meta[it->second];
+        if (!m.loading && m.pages == kAllPages) {
+            // Block already present. We don't overwrite for performance
+            // (assuming read-only ROM usage).
+            return; 
+        }
+        if (m.filling) return; // the claimant is reading into it, see commit_block
+        slot_idx = it->second;
+        if (!m.loading) {
+            // A partial block, filled up now; it is reinserted below
+            shard.policy_of(slot_idx)->on_remove(slot_idx);
+        }
+        m.loading = false;
+        if (m.retired) {
+            // Invalidated while the fetch was in flight: data is stale
+            m.retired = false;
+            shard.key_to_slot.erase(it);
+            shard.release_slot(slot_idx);
+            shard.notify(key);
+            return;
+        }
+    } else {
+        shard.compressed.erase(key); // superseded by the new contents
+        slot_idx = shard.acquire_slot(partition);
+        if (slot_idx == kNil) {
+            return; 
+        }
+        shard.key_to_slot[key] = slot_idx;
+    }
+
+    if (!shard.share(slot_idx, shared) && data != nullptr) {
+        std::memcpy(shard.payload(slot_idx), data, copy_len);
     }
     
-    slot->block_id = block_id;
-    slot->valid = true;
-    slot->last_access = ++access_counter_;
-    
-    id_to_slot_[block_id] = slot_idx;
+    SlotMeta& m = shard.meta[slot_idx];
+    m.key = key;
+    m.valid = true;
+    m.valid_len = static_cast<uint32_t>(copy_len);
+    m.pages = kAllPages;
+    m.generation = generation;
+    shard.policy_of(slot_idx)->on_insert(slot_idx, BlockKeyHash()(key));
     
-    // Notify waiters
-    cv_.notify_all();
+    // Notify waiters of this block only
+    shard.notify(key);
+
+    // A short block is the file's tail
+    lock.unlock();
+    if (copy_len < BLOCK_SIZE) set_file_size(file_id, block_id * BLOCK_SIZE + copy_len);
+
+    DiskCache* disk = disk_.load(std::memory_order_acquire);
+    if (persist && disk && data != nullptr) {
+        uint64_t change = disk_change(file_id);
+        if (change != 0) disk->store({file_id, change, block_id}, data, copy_len);
+    }
+}
+
+// Bits of the sub-blocks overlapping bytes [lo, hi) of a block
+static uint32_t page_mask(size_t lo, size_t hi) {
+    size_t first = lo / SUB_BLOCK_SIZE;
+    size_t last = (hi + SUB_BLOCK_SIZE - 1) / SUB_BLOCK_SIZE;
+    if (last - first >= 32) return UINT32_MAX;
+    return ((1u << (last - first)) - 1) << first;
 }
 
-void BlockCache::invalidate_block(uint64_t block_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = id_to_slot_.find(block_id);
-    if (it != id_to_slot_.end()) {
-        slots_[it->second]->valid = false;
-        id_to_slot_.erase(it);
-        std::cout << "[BlockCache] Invalidated block " << block_id << std::endl;
+void BlockCache::put_range(uint64_t file_id, uint64_t offset, const uint8_t* data, size_t len) {
+    if (data == nullptr || len == 0) return;
+    uint64_t eof = UINT64_MAX;
+    uint32_t partition = 0;
+    uint32_t generation = file_generation(file_id, &eof, &partition);
+    uint64_t end = offset + len;
+
+    for (uint64_t b = offset / BLOCK_SIZE; b * BLOCK_SIZE < end; ++b) {
+        uint64_t block_start = b * BLOCK_SIZE;
+        if (block_start >= eof) break;
+        size_t block_len = (size_t)std::min<uint64_t>(BLOCK_SIZE, eof - block_start);
+        size_t lo = offset > block_start ? (size_t)(offset - block_start) : 0;
+        size_t hi = (size_t)std::min<uint64_t>(end - block_start, block_len);
+        if (lo == 0 && hi == block_len) {
+            publish(file_id, b, data + (block_start - offset), block_len, true);
+            continue;
+        }
+        // Whole sub-blocks only; the last one ends at EOF
+        lo = (lo + SUB_BLOCK_SIZE - 1) / SUB_BLOCK_SIZE * SUB_BLOCK_SIZE;
+        if (hi != block_len) hi = hi / SUB_BLOCK_SIZE * SUB_BLOCK_SIZE;
+        if (lo >= hi) continue;
+
+        BlockKey key = {file_id, b};
+        Shard& shard = shard_for(key);
+        EvictedFlush flush(*this, shard);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.expire(key, generation);
+
+        uint32_t slot_idx = kNil;
+        auto it = shard.key_to_slot.find(key);
+        if (it != shard.key_to_slot.end()) {
+            const SlotMeta& m = shard.meta[it->second];
+            if (m.loading || m.pages == kAllPages) continue; // fetched whole, or held already
+            if (m.valid_len == block_len) {
+                slot_idx = it->second;
+            } else {
+                shard.drop(key); // EOF moved since it was started
+            }
+        } else if (shard.compressed.contains(key)) {
+            continue;
+        }
+        if (slot_idx == kNil) {
+            slot_idx = shard.acquire_slot(partition);
+            if (slot_idx == kNil) continue;
+            SlotMeta& m = shard.meta[slot_idx];
+            m.key = key;
+            m.valid = true;
+            m.loading = false;
+            m.retired = false;
+            m.valid_len = static_cast<uint32_t>(block_len);
+            m.pages = 0;
+            m.generation = generation;
+            shard.key_to_slot[key] = slot_idx;
+            shard.policy_of(slot_idx)->on_insert(slot_idx, BlockKeyHash()(key));
+        } else {
+            shard.policy_of(slot_idx)->on_access(slot_idx);
+        }
+
+        SlotMeta& m = shard.meta[slot_idx];
+        std::memcpy(shard.payload(slot_idx) + lo, data + (block_start + lo - offset), hi - lo);
+        m.pages |= page_mask(lo, hi);
+        uint32_t all = page_mask(0, block_len);
+        if ((m.pages & all) == all) {
+            m.pages = kAllPages;
+            shard.notify(key);
+        }
+        counters_.partial_fills.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
-bool BlockCache::wait_for_block(uint64_t block_id, int timeout_ms) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (id_to_slot_.count(block_id)) return true;
-    
-    return cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this, block_id]{
-        return id_to_slot_.count(block_id) > 0;
-    });
+void BlockCache::set_file_extent(uint64_t file_id, size_t bytes) {
+    bytes = std::min(bytes, kMaxExtent) / SUB_BLOCK_SIZE * SUB_BLOCK_SIZE;
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    files_[file_id].extent = bytes;
+}
+
+size_t BlockCache::file_extent(uint64_t file_id) {
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    auto it = files_.find(file_id);
+    return it == files_.end() ? 0 : it->second.extent;
 }
 
-uint8_t* BlockCache::get_block_ptr(uint64_t block_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = id_to_slot_.find(block_id);
-    if (it != id_to_slot_.end()) {
-        Slot* slot = slots_[it->second].get();
-        slot->last_access = ++access_counter_;
-        return slot->data;
+bool BlockCache::load_from_disk(const BlockKey& key) {
+    DiskCache* disk = disk_.load(std::memory_order_acquire);
+    if (!disk) return false;
+    uint64_t change = disk_change(key.file_id);
+    if (change == 0) return false;
+    DiskKey disk_key = {key.file_id, change, key.block_id};
+    if (!disk->contains(disk_key)) return false;
+
+    thread_local std::unique_ptr<uint8_t[]> buffer(new uint8_t[BLOCK_SIZE]);
+    int len = disk->read(disk_key, buffer.get());
+    if (len < 0) return false;
+    // Completes an outstanding claim on key if there is one
+    publish(key.file_id, key.block_id, buffer.get(), (size_t)len, false);
+    return true;
+}
+
+void BlockCache::fail_block(uint64_t file_id, uint64_t block_id) {
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.key_to_slot.find(key);
+    if (it == shard.key_to_slot.end() || !shard.meta[it->second].loading) return;
+    counters_.fetch_failures.fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t slot_idx = it->second;
+    shard.meta[slot_idx].loading = false;
+    shard.meta[slot_idx].retired = false;
+    shard.key_to_slot.erase(it);
+    shard.release_slot(slot_idx);
+    shard.notify(key);
+}
+
+uint8_t* BlockCache::claim_buffer(uint64_t file_id, uint64_t block_id) {
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.key_to_slot.find(key);
+    if (it == shard.key_to_slot.end() || !shard.meta[it->second].loading) return nullptr;
+    // A loading slot stays mapped and reserved until committed or failed,
+    // even when retired meanwhile, so the claimant may fill it unlocked
+    shard.meta[it->second].filling = true;
+    return shard.payload(it->second);
+}
+
+void BlockCache::commit_block(uint64_t file_id, uint64_t block_id, size_t len) {
+    size_t copy_len = std::min(len, BLOCK_SIZE);
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    const uint8_t* data = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.key_to_slot.find(key);
+        if (it == shard.key_to_slot.end() || !shard.meta[it->second].filling) return;
+        data = shard.payload(it->second);
+    }
+
+    // Still invisible and ours alone: share and persist it without the lock
+    SharedPayload shared(dedup_);
+    shared.acquire(data, copy_len);
+    DiskCache* disk = disk_.load(std::memory_order_acquire);
+    uint64_t change = disk ? disk_change(file_id) : 0;
+    if (change != 0) disk->store({file_id, change, block_id}, data, copy_len);
+
+    uint32_t generation = file_generation(file_id);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.expire(key, generation);
+    auto it = shard.key_to_slot.find(key);
+    if (it == shard.key_to_slot.end() || !shard.meta[it->second].filling) return;
+    uint32_t slot_idx = it->second;
+    SlotMeta& m = shard.meta[slot_idx];
+    m.loading = false;
+    m.filling = false;
+    if (m.retired) {
+        // Invalidated while the fetch was in flight: data is stale
+        m.retired = false;
+        shard.key_to_slot.erase(it);
+        shard.release_slot(slot_idx);
+        shard.notify(key);
+        lock.unlock();
+        if (change != 0) disk->erase({file_id, change, block_id});
+        return;
     }
-    return nullptr;
+    shard.share(slot_idx, shared);
+    m.valid = true;
+    m.valid_len = static_cast<uint32_t>(copy_len);
+    m.pages = kAllPages;
+    m.generation = generation;
+    shard.policy_of(slot_idx)->on_insert(slot_idx, BlockKeyHash()(key));
+    shard.notify(key);
+
+    // A short block is the file's tail
+    lock.unlock();
+    if (copy_len < BLOCK_SIZE) set_file_size(file_id, block_id * BLOCK_SIZE + copy_len);
 }
 
-int BlockCache::read(uint64_t offset, size_t len, uint8_t* out_buffer, size_t* out_actual_len) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    
-    if (id_to_slot_.empty()) {
-        return -1;
+bool BlockCache::in_flight(uint64_t file_id, uint64_t block_id, uint64_t* out_age_us) {
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (!shard.is_loading(key)) return false;
+    if (out_age_us) {
+        *out_age_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - shard.meta[shard.key_to_slot[key]].claimed_at).count();
+    }
+    return true;
+}
+
+void BlockCache::set_file_size(uint64_t file_id, uint64_t size) {
+    uint64_t old_size = 0;
+    {
+        std::lock_guard<std::mutex> lock(files_mutex_);
+        FileInfo& info = files_[file_id];
+        if (!info.size_known) {
+            info.size = size;
+            info.size_known = true;
+            return;
+        }
+        old_size = info.size;
+        info.size = size;
     }
 
+    // The file grew: a cached short tail no longer holds all of its block
+    if (size > old_size && old_size % BLOCK_SIZE != 0) {
+        uint64_t tail = old_size / BLOCK_SIZE;
+        BlockKey key = {file_id, tail};
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        uint32_t slot_idx = shard.find_ready(key);
+        if (slot_idx == kNil) slot_idx = shard.find_partial(key);
+        uint64_t wanted = std::min<uint64_t>(BLOCK_SIZE, size - tail * BLOCK_SIZE);
+        if (slot_idx != kNil && shard.meta[slot_idx].valid_len < wanted) shard.drop(key);
+        shard.compressed.erase(key);
+    }
+}
+
+uint64_t BlockCache::make_change_attr(uint64_t size, uint64_t mtime_sec, uint64_t mtime_nsec) {
+    uint64_t h = make_file_id(size, mtime_sec);
+    return make_file_id(h, mtime_nsec);
+}
+
+void BlockCache::set_file_change(uint64_t file_id, uint64_t change) {
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    files_[file_id].change = change;
+}
+
+uint64_t BlockCache::file_change(uint64_t file_id) {
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    auto it = files_.find(file_id);
+    return it == files_.end() ? 0 : it->second.change;
+}
+
+bool BlockCache::revalidate(uint64_t file_id, uint64_t change) {
+    uint64_t old_change = 0;
+    {
+        std::lock_guard<std::mutex> lock(files_mutex_);
+        FileInfo& info = files_[file_id];
+        // Writes not written back yet are newer than what was seen
+        if (!info.dirty.empty()) return false;
+        old_change = info.change;
+        info.change = change;
+    }
+    if (old_change == 0 || change == 0 || old_change == change) return false;
+    invalidate_file(file_id);
+    return true;
+}
+
+uint32_t BlockCache::file_generation(uint64_t file_id, uint64_t* eof, uint32_t* partition) {
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    auto it = files_.find(file_id);
+    if (it == files_.end()) return 0;
+    if (eof && it->second.size_known) *eof = it->second.size;
+    if (partition) *partition = it->second.partition;
+    return it->second.generation;
+}
+
+uint64_t BlockCache::disk_change(uint64_t file_id) {
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    auto it = files_.find(file_id);
+    if (it == files_.end() || it->second.change == 0) return 0;
+    const FileInfo& info = it->second;
+    return info.generation == 0 ? info.change : make_file_id(info.change, info.generation);
+}
+
+void BlockCache::bump_generation(uint64_t file_id, uint64_t first, uint64_t last) {
+    std::vector<uint64_t> dropped;
+    {
+        std::lock_guard<std::mutex> lock(files_mutex_);
+        FileInfo& info = files_[file_id];
+        info.generation++;
+        for (auto it = info.dirty.lower_bound(first); it != info.dirty.end() && *it <= last;) {
+            dropped.push_back(*it);
+            it = info.dirty.erase(it);
+        }
+    }
+    // Dirty slots are kept off the eviction policy, so these would never age out
+    for (uint64_t b : dropped) {
+        BlockKey key = {file_id, b};
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.drop(key);
+    }
+}
+
+void BlockCache::invalidate_file(uint64_t file_id) {
+    bump_generation(file_id, 0, UINT64_MAX);
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    files_[file_id].size_known = false;
+}
+
+void BlockCache::invalidate_range(uint64_t file_id, uint64_t offset, uint64_t len) {
+    if (len == 0) return;
+    uint64_t first = offset / BLOCK_SIZE;
+    uint64_t last = len > UINT64_MAX - offset ? UINT64_MAX / BLOCK_SIZE : (offset + len - 1) / BLOCK_SIZE;
+    if (last - first >= capacity_slots_.load(std::memory_order_relaxed)) {
+        bump_generation(file_id, first, last);
+        return;
+    }
+    for (uint64_t b = first; b <= last; ++b) invalidate_block(file_id, b);
+}
+
+bool BlockCache::enable_disk_cache(const std::string& dir, size_t capacity_mb) {
+    std::lock_guard<std::mutex> lock(init_mutex_);
+    if (disk_owner_) return false;
+    disk_owner_ = DiskCache::open(dir, capacity_mb, BLOCK_SIZE);
+    if (!disk_owner_) return false;
+    disk_.store(disk_owner_.get(), std::memory_order_release);
+    return true;
+}
+
+void BlockCache::enable_compressed_cache(size_t budget_mb) {
+    std::lock_guard<std::mutex> lock(init_mutex_);
+    compressed_budget_ = budget_mb * 1024 * 1024;
+    if (capacity_slots_ == 0) return; // applied by init
+
+    uint32_t shards = shard_count_.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < shards; ++i) {
+        std::lock_guard<std::mutex> shard_lock(shards_[i].mutex);
+        shards_[i].compressed.set_budget(compressed_budget_ / shards);
+    }
+    if (budget_mb == 0) {
+        std::cout << "[BlockCache] Compressed pool disabled" << std::endl;
+    } else {
+        std::cout << "[BlockCache] Compressed pool of " << budget_mb << " MB" << std::endl;
+    }
+}
+
+bool BlockCache::write_block(uint64_t file_id, uint64_t block_id, size_t off, const uint8_t* data, size_t len, bool dirty) {
+    if (len == 0 || off + len > BLOCK_SIZE) return false;
+    uint64_t eof = UINT64_MAX;
+    uint32_t partition = 0;
+    uint32_t generation = file_generation(file_id, &eof, &partition);
+    uint64_t block_start = block_id * BLOCK_SIZE;
+    if (block_start + off > eof) return false; // would leave a hole
+
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    EvictedFlush flush(*this, shard);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.expire(key, generation);
+
+    uint32_t slot_idx = shard.find_current(key, eof);
+    if (slot_idx == kNil) slot_idx = shard.promote(key, partition);
+    bool fresh = slot_idx == kNil;
+    if (fresh) {
+        // Nothing to apply the write to: it must replace all the block's data
+        uint64_t old_len = eof > block_start ? std::min<uint64_t>(BLOCK_SIZE, eof - block_start) : 0;
+        if (off != 0 || len < old_len || shard.is_loading(key)) return false;
+        shard.drop(key); // a stale short tail
+        slot_idx = shard.acquire_slot(partition);
+        if (slot_idx == kNil) return false;
+        SlotMeta& m = shard.meta[slot_idx];
+        m.key = key;
+        m.valid = true;
+        m.loading = false;
+        m.retired = false;
+        m.valid_len = 0;
+        m.pages = kAllPages;
+        m.generation = generation;
+        shard.key_to_slot[key] = slot_idx;
+    }
+    bool moved = false;
+    if (!fresh && shard.meta[slot_idx].pins > 0) {
+        // Pin holders read the block unlocked: write to a copy that takes
+        // the key over, and retire the pinned slot as drop() does
+        uint32_t pinned = slot_idx;
+        slot_idx = shard.acquire_slot(partition);
+        if (slot_idx == kNil) return false;
+        SlotMeta& old = shard.meta[pinned];
+        SlotMeta& m = shard.meta[slot_idx];
+        std::memcpy(shard.payload(slot_idx), shard.payload(pinned), old.valid_len);
+        m.key = key;
+        m.valid = true;
+        m.loading = false;
+        m.retired = false;
+        m.valid_len = old.valid_len;
+        m.pages = old.pages;
+        m.generation = old.generation;
+        m.write_seq = old.write_seq;
+        m.dirty = old.dirty; // the copy carries the unwritten range over
+        m.dirty_lo = old.dirty_lo;
+        m.dirty_hi = old.dirty_hi;
+        old.dirty = false;
+        old.valid = false;
+        old.retired = true;
+        shard.key_to_slot[key] = slot_idx;
+        moved = true;
+    }
+
+    SlotMeta& m = shard.meta[slot_idx];
+    uint8_t* dst = shard.make_private(slot_idx);
+    if (dst == nullptr) {
+        if (fresh) {
+            shard.key_to_slot.erase(key);
+            shard.release_slot(slot_idx);
+        }
+        return false;
+    }
+    if (off > m.valid_len) std::memset(dst + m.valid_len, 0, off - m.valid_len);
+    std::memcpy(dst + off, data, len);
+    m.valid_len = std::max<uint32_t>(m.valid_len, static_cast<uint32_t>(off + len));
+    m.write_seq++;
+
+    bool newly_dirty = false;
+    if (dirty && m.dirty) {
+        m.dirty_lo = std::min<uint32_t>(m.dirty_lo, static_cast<uint32_t>(off));
+        m.dirty_hi = std::max<uint32_t>(m.dirty_hi, static_cast<uint32_t>(off + len));
+    } else if (dirty) {
+        m.dirty = true;
+        m.dirty_lo = static_cast<uint32_t>(off);
+        m.dirty_hi = static_cast<uint32_t>(off + len);
+        shard.dirty_blocks.fetch_add(1, std::memory_order_relaxed);
+        shard.policy_of(slot_idx)->on_remove(slot_idx);
+        newly_dirty = true;
+    } else if (fresh || moved) {
+        if (!m.dirty) shard.policy_of(slot_idx)->on_insert(slot_idx, BlockKeyHash()(key));
+    } else {
+        shard.policy_of(slot_idx)->on_access(slot_idx);
+    }
+    if (fresh) shard.notify(key);
+    uint64_t end = block_start + m.valid_len;
+    lock.unlock();
+
+    if (dirty) counters_.absorbed_writes.fetch_add(1, std::memory_order_relaxed);
+    if (newly_dirty) {
+        std::lock_guard<std::mutex> files_lock(files_mutex_);
+        FileInfo& info = files_[file_id];
+        if (info.dirty.empty()) info.dirty_since = std::chrono::steady_clock::now();
+        info.dirty.insert(block_id);
+    }
+    if (eof != UINT64_MAX && end > eof) set_file_size(file_id, end);
+
+    // The disk tier's copy no longer matches
+    DiskCache* disk = disk_.load(std::memory_order_acquire);
+    uint64_t change = disk ? disk_change(file_id) : 0;
+    if (change != 0) disk->erase({file_id, change, block_id});
+    return true;
+}
+
+void BlockCache::write_through(uint64_t file_id, uint64_t offset, const uint8_t* data, size_t len) {
+    uint64_t pos = offset;
+    for (size_t done = 0; done < len;) {
+        uint64_t b = pos / BLOCK_SIZE;
+        size_t off = pos % BLOCK_SIZE;
+        size_t n = std::min(BLOCK_SIZE - off, len - done);
+        if (!write_block(file_id, b, off, data + done, n, false)) invalidate_block(file_id, b);
+        done += n;
+        pos += n;
+    }
+    uint64_t eof = 0;
+    if (file_size(file_id, &eof) && offset + len > eof) set_file_size(file_id, offset + len);
+}
+
+bool BlockCache::diff_cached(uint64_t file_id, uint64_t offset, const uint8_t* data, size_t len, size_t min_gap,
+                             std::vector<WriteRange>* out) {
+    constexpr size_t kGranule = 512;
+    out->clear();
+    uint64_t eof = UINT64_MAX;
+    uint32_t partition = 0;
+    uint32_t generation = file_generation(file_id, &eof, &partition);
+
+    // Current run of changed bytes, relative to the write's start
+    size_t run_lo = 0, run_hi = 0;
+    bool in_run = false;
+    auto changed = [&](size_t lo, size_t hi) {
+        if (in_run && lo <= run_hi + min_gap) {
+            run_hi = hi;
+            return;
+        }
+        if (in_run) out->push_back({run_lo, run_hi - run_lo});
+        run_lo = lo;
+        run_hi = hi;
+        in_run = true;
+    };
+
+    for (size_t pos = 0; pos < len;) {
+        uint64_t b = (offset + pos) / BLOCK_SIZE;
+        size_t off = (offset + pos) % BLOCK_SIZE;
+        size_t n = std::min(BLOCK_SIZE - off, len - pos);
+        BlockKey key = {file_id, b};
+        Shard& shard = shard_for(key);
+        EvictedFlush flush(*this, shard);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.expire(key, generation);
+        uint32_t slot_idx = shard.find_current(key, eof);
+        if (slot_idx == kNil) slot_idx = shard.promote(key, partition);
+
+        size_t old_end = off; // block offset where the cached data ends
+        if (slot_idx != kNil) {
+            const SlotMeta& m = shard.meta[slot_idx];
+            if (m.dirty) return false;
+            old_end = std::max(off, std::min<size_t>(m.valid_len, off + n));
+            const uint8_t* old = shard.payload(slot_idx);
+            for (size_t g = off; g < old_end;) {
+                size_t g_end = std::min(old_end, (g / kGranule + 1) * kGranule);
+                if (std::memcmp(old + g, data + pos + (g - off), g_end - g) != 0) {
+                    changed(pos + (g - off), pos + (g_end - off));
+                }
+                g = g_end;
+            }
+        } else if (eof == UINT64_MAX || b * BLOCK_SIZE + off < eof) {
+            return false; // the server has data here we do not know
+        }
+        if (old_end < off + n) changed(pos + (old_end - off), pos + n);
+        pos += n;
+    }
+    if (in_run) out->push_back({run_lo, run_hi - run_lo});
+    return true;
+}
+
+void BlockCache::record_delta_write(size_t len, size_t sent, bool fell_back) {
+    counters_.delta_writes.fetch_add(1, std::memory_order_relaxed);
+    if (fell_back) counters_.delta_fallbacks.fetch_add(1, std::memory_order_relaxed);
+    counters_.delta_bytes_sent.fetch_add(sent, std::memory_order_relaxed);
+    counters_.delta_bytes_saved.fetch_add(len - sent, std::memory_order_relaxed);
+}
+
+std::vector<BlockCache::DirtyExtent> BlockCache::collect_dirty(uint64_t file_id, size_t max_bytes) {
+    std::vector<uint64_t> blocks;
+    {
+        std::lock_guard<std::mutex> lock(files_mutex_);
+        auto it = files_.find(file_id);
+        if (it != files_.end()) blocks.assign(it->second.dirty.begin(), it->second.dirty.end());
+    }
+
+    std::vector<DirtyExtent> out;
+    std::vector<uint64_t> stale;
+    uint64_t prev_block = UINT64_MAX;
+    bool prev_reached_end = false; // the last block was copied to its end
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        uint64_t b = blocks[i];
+        BlockKey key = {file_id, b};
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        uint32_t slot_idx = shard.find_ready(key);
+        if (slot_idx == kNil || !shard.meta[slot_idx].dirty) {
+            stale.push_back(b);
+            continue;
+        }
+
+        const SlotMeta& m = shard.meta[slot_idx];
+        bool merge = !out.empty() && prev_block + 1 == b && prev_reached_end &&
+                     out.back().data.size() < max_bytes;
+        // Copy up to the block's end if the next block is dirty too, so the
+        // two can share a WRITE
+        bool next_dirty = i + 1 < blocks.size() && blocks[i + 1] == b + 1;
+        uint32_t from = merge ? 0 : m.dirty_lo;
+        uint32_t to = next_dirty ? m.valid_len : m.dirty_hi;
+        if (!merge) {
+            out.emplace_back();
+            out.back().offset = b * BLOCK_SIZE + from;
+        }
+        const uint8_t* src = shard.payload(slot_idx);
+        out.back().data.insert(out.back().data.end(), src + from, src + to);
+        out.back().blocks.push_back({b, m.write_seq});
+        prev_block = b;
+        prev_reached_end = to == BLOCK_SIZE;
+    }
+
+    if (!stale.empty()) {
+        std::lock_guard<std::mutex> lock(files_mutex_);
+        FileInfo& info = files_[file_id];
+        for (uint64_t b : stale) info.dirty.erase(b);
+    }
+    return out;
+}
+
+void BlockCache::mark_clean(uint64_t file_id, const DirtyExtent& extent) {
+    std::vector<uint64_t> cleaned;
+    for (const auto& block : extent.blocks) {
+        BlockKey key = {file_id, block.first};
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        uint32_t slot_idx = shard.find_ready(key);
+        if (slot_idx == kNil) continue;
+        SlotMeta& m = shard.meta[slot_idx];
+        if (!m.dirty || m.write_seq != block.second) continue; // written again meanwhile
+        m.dirty = false;
+        shard.dirty_blocks.fetch_sub(1, std::memory_order_relaxed);
+        if (m.pins == 0) shard.policy_of(slot_idx)->on_reinsert(slot_idx);
+        cleaned.push_back(block.first);
+    }
+    counters_.flush_writes.fetch_add(1, std::memory_order_relaxed);
+    counters_.flushed_bytes.fetch_add(extent.data.size(), std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    FileInfo& info = files_[file_id];
+    for (uint64_t b : cleaned) info.dirty.erase(b);
+}
+
+size_t BlockCache::discard_dirty(uint64_t file_id) {
+    std::set<uint64_t> blocks;
+    {
+        std::lock_guard<std::mutex> lock(files_mutex_);
+        auto it = files_.find(file_id);
+        if (it != files_.end()) blocks.swap(it->second.dirty);
+    }
+    size_t dropped = 0;
+    for (uint64_t b : blocks) {
+        BlockKey key = {file_id, b};
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        uint32_t slot_idx = shard.find_ready(key);
+        if (slot_idx != kNil && shard.meta[slot_idx].dirty && shard.drop(key)) dropped++;
+    }
+    return dropped;
+}
+
+bool BlockCache::has_dirty(uint64_t file_id) {
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    auto it = files_.find(file_id);
+    return it != files_.end() && !it->second.dirty.empty();
+}
+
+std::vector<uint64_t> BlockCache::dirty_files(std::chrono::milliseconds min_age) {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<uint64_t> out;
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    for (const auto& entry : files_) {
+        if (!entry.second.dirty.empty() && now - entry.second.dirty_since >= min_age) {
+            out.push_back(entry.first);
+        }
+    }
+    return out;
+}
+
+size_t BlockCache::pinned_blocks() const {
+    size_t blocks = 0;
+    uint32_t shards = shard_count_.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < shards; ++i) {
+        blocks += shards_[i].pinned_slots.load(std::memory_order_relaxed);
+    }
+    return blocks;
+}
+
+size_t BlockCache::dirty_bytes() const {
+    size_t blocks = 0;
+    uint32_t shards = shard_count_.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < shards; ++i) {
+        blocks += shards_[i].dirty_blocks.load(std::memory_order_relaxed);
+    }
+    return blocks * BLOCK_SIZE;
+}
+
+void BlockCache::overlay_dirty(uint64_t file_id, uint64_t offset, uint8_t* buf, size_t len) {
+    if (len == 0) return;
+    std::vector<uint64_t> blocks;
+    {
+        std::lock_guard<std::mutex> lock(files_mutex_);
+        auto it = files_.find(file_id);
+        if (it == files_.end()) return;
+        const std::set<uint64_t>& dirty = it->second.dirty;
+        uint64_t last = (offset + len - 1) / BLOCK_SIZE;
+        for (auto b = dirty.lower_bound(offset / BLOCK_SIZE); b != dirty.end() && *b <= last; ++b) {
+            blocks.push_back(*b);
+        }
+    }
+
+    for (uint64_t b : blocks) {
+        BlockKey key = {file_id, b};
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        uint32_t slot_idx = shard.find_ready(key);
+        if (slot_idx == kNil || !shard.meta[slot_idx].dirty) continue;
+        const SlotMeta& m = shard.meta[slot_idx];
+        uint64_t lo = std::max<uint64_t>(b * BLOCK_SIZE + m.dirty_lo, offset);
+        uint64_t hi = std::min<uint64_t>(b * BLOCK_SIZE + m.dirty_hi, offset + len);
+        if (lo < hi) {
+            std::memcpy(buf + (lo - offset), shard.payload(slot_idx) + (lo - b * BLOCK_SIZE), hi - lo);
+        }
+    }
+}
+
+void BlockCache::set_flush_handler(void (*handler)()) {
+    flush_handler_.store(handler, std::memory_order_release);
+}
+
+bool BlockCache::file_size(uint64_t file_id, uint64_t* out_size) {
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    auto it = files_.find(file_id);
+    if (it == files_.end() || !it->second.size_known) return false;
+    if (out_size) *out_size = it->second.size;
+    return true;
+}
+
+BlockCacheStats BlockCache::stats() {
+    BlockCacheStats out;
+    out.resident_bytes = 0;
+    CompressedPool::Stats pool = {0, 0, 0, 0, 0, 0, 0};
+    uint32_t shards = shard_count_.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < shards; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        out.resident_bytes += shards_[i].arena.committed_bytes();
+        const CompressedPool::Stats& s = shards_[i].compressed.stats();
+        pool.stores += s.stores;
+        pool.rejects += s.rejects;
+        pool.hits += s.hits;
+        pool.raw_bytes += s.raw_bytes;
+        pool.stored_bytes += s.stored_bytes;
+        pool.resident_bytes += s.resident_bytes;
+        pool.decompress_ns += s.decompress_ns;
+    }
+    out.compressed_stores = pool.stores;
+    out.compressed_rejects = pool.rejects;
+    out.compressed_hits = pool.hits;
+    out.compressed_raw_bytes = pool.raw_bytes;
+    out.compressed_stored_bytes = pool.stored_bytes;
+    out.compressed_resident_bytes = pool.resident_bytes;
+    out.decompress_ns = pool.decompress_ns;
+    out.dirty_bytes = dirty_bytes();
+    out.absorbed_writes = counters_.absorbed_writes.load(std::memory_order_relaxed);
+    out.flush_writes = counters_.flush_writes.load(std::memory_order_relaxed);
+    out.flushed_bytes = counters_.flushed_bytes.load(std::memory_order_relaxed);
+    out.delta_writes = counters_.delta_writes.load(std::memory_order_relaxed);
+    out.delta_fallbacks = counters_.delta_fallbacks.load(std::memory_order_relaxed);
+    out.delta_bytes_sent = counters_.delta_bytes_sent.load(std::memory_order_relaxed);
+    out.delta_bytes_saved = counters_.delta_bytes_saved.load(std::memory_order_relaxed);
+    DedupStore::Stats shared = dedup_.stats();
+    out.resident_bytes += dedup_.committed_bytes();
+    out.dedup_refs = shared.refs;
+    out.dedup_unique = shared.unique;
+    out.dedup_logical_bytes = shared.logical_bytes;
+    out.dedup_stored_bytes = shared.stored_bytes;
+    out.partial_fills = counters_.partial_fills.load(std::memory_order_relaxed);
+    out.partial_hits = counters_.partial_hits.load(std::memory_order_relaxed);
+    out.trimmed_bytes = counters_.trimmed_bytes.load(std::memory_order_relaxed);
+    DiskCache::Stats disk = {0, 0, 0, 0};
+    if (DiskCache* d = disk_.load(std::memory_order_acquire)) disk = d->stats();
+    out.disk_hits = disk.hits;
+    out.disk_misses = disk.misses;
+    out.disk_writes = disk.writes;
+    out.disk_corrupt = disk.corrupt;
+    out.hits = counters_.hits.load(std::memory_order_relaxed);
+    out.misses = counters_.misses.load(std::memory_order_relaxed);
+    out.fetch_claims = counters_.fetch_claims.load(std::memory_order_relaxed);
+    out.dedup_present = counters_.dedup_present.load(std::memory_order_relaxed);
+    out.dedup_inflight = counters_.dedup_inflight.load(std::memory_order_relaxed);
+    out.fetch_failures = counters_.fetch_failures.load(std::memory_order_relaxed);
+    return out;
+}
+
+size_t BlockCache::trim(CacheTrimLevel level) {
+    // Dirty blocks cannot be dropped until they are written back
+    void (*flush)() = flush_handler_.load(std::memory_order_acquire);
+    if (flush && level >= kTrimModerate && dirty_bytes() > 0) flush();
+
+    uint32_t shards = shard_count_.load(std::memory_order_relaxed);
+    size_t released = 0;
+    size_t shared_before = dedup_.committed_bytes();
+    for (uint32_t i = 0; i < shards; ++i) {
+        Shard& shard = shards_[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size_t target = shard.live();
+        size_t pool_target = shard.compressed.budget(); // scaled like the slots
+        switch (level) {
+            case kTrimFreeSlots: break;
+            case kTrimModerate:
+                target = std::min(target, shard.capacity / 2);
+                pool_target /= 2;
+                break;
+            case kTrimLow:
+                target = std::min(target, shard.capacity / 4);
+                pool_target /= 4;
+                break;
+            case kTrimComplete:
+                target = 0;
+                pool_target = 0;
+                break;
+        }
+        released += shard.shed(target, false);
+        // Pool memory goes back to the allocator rather than straight to the OS
+        released += shard.compressed.shrink(pool_target);
+    }
+    // Shared payloads whose last block was dropped
+    released += shared_before - std::min(shared_before, dedup_.committed_bytes());
+    counters_.trimmed_bytes.fetch_add(released, std::memory_order_relaxed);
+    std::cout << "[BlockCache] Trim level " << level << " released "
+              << released / 1024 << " KB" << std::endl;
+    return released;
+}
+
+void BlockCache::invalidate_block(uint64_t file_id, uint64_t block_id) {
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.drop(key);
+    lock.unlock();
+
+    DiskCache* disk = disk_.load(std::memory_order_acquire);
+    uint64_t change = disk ? disk_change(file_id) : 0;
+    if (change != 0) disk->erase({file_id, change, block_id});
+}
+
+bool BlockCache::wait_for_block(uint64_t file_id, uint64_t block_id, int timeout_ms) {
+    return wait_for_block_us(file_id, block_id, timeout_ms > 0 ? (uint32_t)timeout_ms * 1000 : 0);
+}
+
+bool BlockCache::wait_for_block_us(uint64_t file_id, uint64_t block_id, uint32_t timeout_us) {
+    using clock = std::chrono::steady_clock;
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    const auto start = clock::now();
+    const auto deadline = start + std::chrono::microseconds(timeout_us);
+
+    bool was_loading = false;
+    // Resolved means the block is ready, or the fetch we saw start has failed
+    auto resolved = [&shard, &key, &was_loading] {
+        if (shard.find_ready(key) != kNil) return true;
+        return was_loading && !shard.is_loading(key);
+    };
+    auto waited_us = [&start] {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count();
+    };
+
+    uint32_t generation = file_generation(file_id);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.expire(key, generation);
+        if (shard.find_ready(key) != kNil) return true;
+        was_loading = shard.is_loading(key);
+    }
+
+    // Phase 1: spin briefly. Arrivals within the spin window are consumed
+    // without a park/unpark round trip through the scheduler.
+    uint32_t spin_us = std::min(spin_budget_us_.load(std::memory_order_relaxed), timeout_us);
+    if (spin_us > 0) {
+        const auto spin_end = start + std::chrono::microseconds(spin_us);
+        uint64_t seen = shard.publish_seq.load(std::memory_order_acquire);
+        for (uint32_t i = 1; clock::now() < spin_end; ++i) {
+            uint64_t cur = shard.publish_seq.load(std::memory_order_acquire);
+            if (cur != seen) {
+                seen = cur;
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                if (resolved()) {
+                    adapt_spin(true, waited_us());
+                    return shard.find_ready(key) != kNil;
+                }
+            }
+            if (i % 64 == 0) std::this_thread::yield(); else cpu_relax();
+        }
+    }
+
+    // Phase 2: park on this block's own queue until it resolves or times out
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    auto& queue = shard.waiters[key];
+    if (!queue) queue.reset(new WaitQueue());
+    WaitQueue* wq = queue.get();
+    wq->waiters++;
+    bool done = wq->cv.wait_until(lock, deadline, resolved);
+    if (--wq->waiters == 0) shard.waiters.erase(key);
+    bool ready = shard.find_ready(key) != kNil;
+    lock.unlock();
+
+    adapt_spin(false, done ? waited_us() : UINT64_MAX);
+    return ready;
+}
+
+void BlockCache::set_wait_spin_limit_us(uint32_t limit_us) {
+    spin_limit_us_.store(limit_us, std::memory_order_relaxed);
+    spin_budget_us_.store(limit_us / 4, std::memory_order_relaxed);
+}
+
+void BlockCache::adapt_spin(bool resolved_while_spinning, uint64_t waited_us) {
+    // Grow the spin budget while blocks keep landing within (or just past)
+    // it, shrink it when waits are long and spinning only burns CPU.
+    uint32_t limit = spin_limit_us_.load(std::memory_order_relaxed);
+    uint32_t budget = spin_budget_us_.load(std::memory_order_relaxed);
+    if (resolved_while_spinning || waited_us <= std::max<uint64_t>((uint64_t)budget * 2, 20)) {
+        budget = std::min(limit, budget + budget / 2 + 1);
+    } else {
+        budget /= 2;
+    }
+    spin_budget_us_.store(budget, std::memory_order_relaxed);
+}
+
+BlockCache::Pin BlockCache::pin_block(uint64_t file_id, uint64_t block_id) {
+    uint32_t partition = 0;
+    uint32_t generation = file_generation(file_id, nullptr, &partition);
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    EvictedFlush flush(*this, shard);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.expire(key, generation);
+    Pin pin;
+    uint32_t slot_idx = shard.find_ready(key);
+    if (slot_idx == kNil) slot_idx = shard.promote(key, partition);
+    if (slot_idx != kNil) {
+        shard.pin(slot_idx);
+        pin.shard_ = &shard;
+        pin.slot_ = slot_idx;
+        pin.data_ = shard.payload(slot_idx);
+        pin.size_ = shard.meta[slot_idx].valid_len;
+    }
+    return pin;
+}
+
+bool BlockCache::contains(uint64_t file_id, uint64_t block_id) {
+    uint32_t generation = file_generation(file_id);
+    BlockKey key = {file_id, block_id};
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.expire(key, generation);
+    return shard.find_ready(key) != kNil || shard.compressed.contains(key);
+}
+
+int BlockCache::read(uint64_t file_id, uint64_t offset, size_t len, uint8_t* out_buffer, size_t* out_actual_len) {
+    if (len == 0) return -1;
+
+    uint64_t eof = UINT64_MAX;
+    uint32_t partition = 0;
+    uint32_t generation = file_generation(file_id, &eof, &partition);
+    PartitionCounters& part_counters = partition_counters_[partition];
+    if (offset >= eof) {
+        if (out_actual_len) *out_actual_len = 0;
+        return 0;
+    }
+    len = (size_t)std::min<uint64_t>(len, eof - offset);
+
     uint64_t start_block = offset / BLOCK_SIZE;
     uint64_t end_block = (offset + len - 1) / BLOCK_SIZE;
     size_t copied = 0;
     
+    // Each block is copied under its own shard lock, so a multi-block read
+    // never holds more than one lock at a time.
     for (uint64_t b = start_block; b <= end_block; ++b) {
-        auto it = id_to_slot_.find(b);
-        if (it == id_to_slot_.end()) {
+        BlockKey key = {file_id, b};
+        Shard& shard = shard_for(key);
+        EvictedFlush flush(*this, shard);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        shard.expire(key, generation);
+
+        uint32_t slot_idx = shard.find_current(key, eof);
+        if (slot_idx == kNil && shard.promote(key, partition) != kNil) {
+            slot_idx = shard.find_current(key, eof);
+        }
+        if (slot_idx == kNil && disk_.load(std::memory_order_relaxed) != nullptr) {
+            lock.unlock();
+            bool promoted = load_from_disk(key);
+            lock.lock();
+            if (promoted) slot_idx = shard.find_current(key, eof);
+        }
+        size_t block_offset = (b == start_block) ? (offset % BLOCK_SIZE) : 0;
+        if (slot_idx == kNil) {
+            // A partial block serves the sub-blocks it holds from here on
+            uint32_t part_idx = shard.find_partial(key);
+            size_t held = part_idx != kNil ? shard.held_bytes(part_idx, block_offset, len - copied) : 0;
+            if (held > 0) {
+                counters_.hits.fetch_add(1, std::memory_order_relaxed);
+                counters_.partial_hits.fetch_add(1, std::memory_order_relaxed);
+                part_counters.hits.fetch_add(1, std::memory_order_relaxed);
+                shard.policy_of(part_idx)->on_access(part_idx);
+                if (out_buffer != nullptr) {
+                    std::memcpy(out_buffer + copied, shard.payload(part_idx) + block_offset, held);
+                }
+                copied += held;
+                if (block_offset + held < BLOCK_SIZE) break; // a sub-block it lacks, or EOF
+                continue;
+            }
+            counters_.misses.fetch_add(1, std::memory_order_relaxed);
+            part_counters.misses.fetch_add(1, std::memory_order_relaxed);
             // Missed a block. 
             // If we copied something already, that's a partial hit.
             // If we missed the VERY FIRST block, return -1.
@@ -140,16 +1652,18 @@ int BlockCache::read(uint64_t offset, size_t len, uint8_t* out_buffer, size_t* o
             return -1; 
         }
         
-        Slot* slot = slots_[it->second].get();
-        slot->last_access = ++access_counter_;
+        counters_.hits.fetch_add(1, std::memory_order_relaxed);
+        part_counters.hits.fetch_add(1, std::memory_order_relaxed);
+        shard.policy_of(slot_idx)->on_access(slot_idx);
         
-        size_t block_offset = (b == start_block) ? (offset % BLOCK_SIZE) : 0;
-        size_t available = BLOCK_SIZE - block_offset;
+        size_t valid_len = shard.meta[slot_idx].valid_len;
+        if (block_offset >= valid_len) break; // EOF
+        size_t available = valid_len - block_offset;
         size_t remaining_req = len - copied;
         size_t to_copy = std::min(available, remaining_req);
         
         if (out_buffer != nullptr) {
-            std::memcpy(out_buffer + copied, slot->data + block_offset, to_copy);
+            std::memcpy(out_buffer + copied, shard.payload(slot_idx) + block_offset, to_copy);
         }
         copied += to_copy;
     }
@@ -169,17 +1683,153 @@ extern "C" {
     EXPORT void cache_init(int capacity_mb) {
         BlockCache::instance().init(capacity_mb);
     }
+
+    EXPORT void cache_init_with_policy(int capacity_mb, int policy) {
+        EvictionPolicyType type = policy == kEvictS3Fifo ? kEvictS3Fifo : kEvictLru;
+        BlockCache::instance().init(capacity_mb, type);
+    }
+
+    EXPORT int cache_resize(int capacity_mb) {
+        if (capacity_mb <= 0) return -1;
+        return BlockCache::instance().resize(capacity_mb) ? 0 : -1;
+    }
+
+    EXPORT int64_t cache_trim(int level) {
+        if (level < kTrimFreeSlots) level = kTrimFreeSlots;
+        if (level > kTrimComplete) level = kTrimComplete;
+        return (int64_t)BlockCache::instance().trim(static_cast<CacheTrimLevel>(level));
+    }
+    
+    EXPORT uint64_t cache_make_file_id(uint64_t fsid, uint64_t fileid) {
+        return BlockCache::make_file_id(fsid, fileid);
+    }
+
+    EXPORT int cache_file_read(uint64_t file_id, uint64_t offset, int len, uint8_t* out_ptr) {
+        return BlockCache::instance().read(file_id, offset, len, out_ptr);
+    }
     
+    EXPORT void cache_file_put(uint64_t file_id, uint64_t block_id, const uint8_t* data, int len) {
+        BlockCache::instance().put_block(file_id, block_id, data, len);
+    }
+    
+    EXPORT void cache_file_put_range(uint64_t file_id, uint64_t offset, const uint8_t* data, int len) {
+        if (len > 0) BlockCache::instance().put_range(file_id, offset, data, len);
+    }
+
+    EXPORT void cache_file_set_extent(uint64_t file_id, int bytes) {
+        BlockCache::instance().set_file_extent(file_id, bytes > 0 ? bytes : 0);
+    }
+
+    EXPORT void cache_file_set_size(uint64_t file_id, uint64_t size) {
+        BlockCache::instance().set_file_size(file_id, size);
+    }
+
+    EXPORT uint64_t cache_make_change_attr(uint64_t size, uint64_t mtime_sec, uint64_t mtime_nsec) {
+        return BlockCache::make_change_attr(size, mtime_sec, mtime_nsec);
+    }
+
+    EXPORT void cache_file_set_change(uint64_t file_id, uint64_t change) {
+        BlockCache::instance().set_file_change(file_id, change);
+    }
+
+    EXPORT int cache_file_revalidate(uint64_t file_id, uint64_t change) {
+        return BlockCache::instance().revalidate(file_id, change) ? 1 : 0;
+    }
+
+    EXPORT void cache_file_invalidate(uint64_t file_id) {
+        BlockCache::instance().invalidate_file(file_id);
+    }
+
+    EXPORT void cache_file_invalidate_range(uint64_t file_id, uint64_t offset, uint64_t len) {
+        BlockCache::instance().invalidate_range(file_id, offset, len);
+    }
+
+    EXPORT int cache_enable_disk(const char* dir, int capacity_mb) {
+        if (!dir || capacity_mb <= 0) return -1;
+        return BlockCache::instance().enable_disk_cache(dir, capacity_mb) ? 0 : -1;
+    }
+
+    EXPORT void cache_enable_compression(int budget_mb) {
+        BlockCache::instance().enable_compressed_cache(budget_mb > 0 ? budget_mb : 0);
+    }
+
+    EXPORT int cache_create_partition(const char* name, int capacity_mb, int borrow) {
+        if (!name || capacity_mb <= 0) return -1;
+        return BlockCache::instance().create_partition(name, capacity_mb, borrow != 0);
+    }
+
+    EXPORT void cache_file_set_partition(uint64_t file_id, int partition) {
+        BlockCache::instance().set_file_partition(file_id, partition);
+    }
+
+    EXPORT int cache_get_partition_stats(int partition, CachePartitionStats* out) {
+        if (!out) return -1;
+        return BlockCache::instance().partition_stats(partition, out) ? 0 : -1;
+    }
+
+    EXPORT void cache_enable_dedup(int enabled) {
+        BlockCache::instance().enable_dedup(enabled != 0);
+    }
+
+    EXPORT int64_t cache_file_size(uint64_t file_id) {
+        uint64_t size = 0;
+        return BlockCache::instance().file_size(file_id, &size) ? (int64_t)size : -1;
+    }
+
+    EXPORT int cache_file_has_block(uint64_t file_id, uint64_t block_id) {
+        return BlockCache::instance().contains(file_id, block_id) ? 1 : 0;
+    }
+
+    EXPORT int cache_file_claim(uint64_t file_id, uint64_t block_id) {
+        return static_cast<int>(BlockCache::instance().claim_block(file_id, block_id));
+    }
+
+    EXPORT void cache_file_complete(uint64_t file_id, uint64_t block_id, const uint8_t* data, int len) {
+        BlockCache::instance().complete_block(file_id, block_id, data, len);
+    }
+
+    EXPORT uint8_t* cache_file_claim_buffer(uint64_t file_id, uint64_t block_id) {
+        return BlockCache::instance().claim_buffer(file_id, block_id);
+    }
+
+    EXPORT void cache_file_commit(uint64_t file_id, uint64_t block_id, int len) {
+        BlockCache::instance().commit_block(file_id, block_id, len > 0 ? len : 0);
+    }
+
+    EXPORT void cache_file_fail(uint64_t file_id, uint64_t block_id) {
+        BlockCache::instance().fail_block(file_id, block_id);
+    }
+
+    EXPORT void cache_get_stats(BlockCacheStats* out) {
+        if (out) *out = BlockCache::instance().stats();
+    }
+
+    EXPORT void cache_set_wait_spin_us(int limit_us) {
+        BlockCache::instance().set_wait_spin_limit_us(limit_us > 0 ? (uint32_t)limit_us : 0);
+    }
+
+    EXPORT void* cache_pin_block(uint64_t file_id, uint64_t block_id, const uint8_t** out_data, int* out_len) {
+        BlockCache::Pin pin = BlockCache::instance().pin_block(file_id, block_id);
+        if (!pin) return nullptr;
+        if (out_data) *out_data = pin.data();
+        if (out_len) *out_len = static_cast<int>(pin.size());
+        return new BlockCache::Pin(std::move(pin));
+    }
+
+    EXPORT void cache_unpin_block(void* pin) {
+        delete static_cast<BlockCache::Pin*>(pin);
+    }
+
     EXPORT int cache_read(uint64_t offset, int len, uint8_t* out_ptr) {
-        return BlockCache::instance().read(offset, len, out_ptr);
+        return cache_file_read(0, offset, len, out_ptr);
     }
     
     EXPORT void cache_put(uint64_t block_id, const uint8_t* data, int len) {
-        BlockCache::instance().put_block(block_id, data, len);
+        cache_file_put(0, block_id, data, len);
     }
     
     EXPORT int cache_has_block(uint64_t block_id) {
-        return BlockCache::instance().get_block_ptr(block_id) != nullptr ? 1 : 0;
+        return cache_file_has_block(0, block_id);
     }
     
     EXPORT int cache_get_block_size() {
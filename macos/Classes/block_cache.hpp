@@ -8,59 +8,686 @@
 #include <mutex>
 #include <memory>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "block_key.hpp"
+#include "compressed_pool.hpp"
+#include "dedup_store.hpp"
+#include "eviction_policy.hpp"
+#include "slab_arena.hpp"
+#include "disk_cache.hpp"
 
 // 128KB Block Size
 constexpr size_t BLOCK_SIZE = 128 * 1024;
+// Granularity of partially cached blocks (see BlockCache::put_range)
+constexpr size_t SUB_BLOCK_SIZE = 4 * 1024;
+static_assert(BLOCK_SIZE / SUB_BLOCK_SIZE == 32, "one bit per sub-block in a uint32_t");
+
+// Counters exposed through cache_get_stats (C layout, mirrored in Dart)
+struct BlockCacheStats {
+    uint64_t hits;           // blocks served from cache by read()
+    uint64_t misses;         // read() stopped at a missing block
+    uint64_t fetch_claims;   // claims granted: one network fetch each
+    uint64_t dedup_present;  // claims refused because the block was cached
+    uint64_t dedup_inflight; // claims refused because a fetch was in flight
+    uint64_t fetch_failures; // claims released through fail_block
+    uint64_t resident_bytes; // slot memory currently committed
+    uint64_t trimmed_bytes;  // memory returned to the OS by trim(), in total
+    uint64_t disk_hits;      // blocks promoted from the disk tier
+    uint64_t disk_misses;    // disk tier lookups that found nothing usable
+    uint64_t disk_writes;    // blocks written to the disk tier
+    uint64_t disk_corrupt;   // disk entries dropped on a checksum mismatch
+    uint64_t compressed_stores;   // evicted blocks kept in the compressed pool
+    uint64_t compressed_rejects;  // evicted blocks that did not compress well enough
+    uint64_t compressed_hits;     // misses served by decompressing from the pool
+    uint64_t compressed_raw_bytes;    // input bytes of all stores
+    uint64_t compressed_stored_bytes; // their compressed size (ratio = raw / stored)
+    uint64_t compressed_resident_bytes; // pool memory currently held
+    uint64_t decompress_ns;       // total time decompressing hits
+    uint64_t dirty_bytes;     // memory held by dirty blocks, awaiting write-back
+    uint64_t absorbed_writes; // writes applied to cached blocks and deferred
+    uint64_t flush_writes;    // WRITEs issued by flushes, after coalescing
+    uint64_t flushed_bytes;   // bytes written back by flushes
+    uint64_t delta_writes;     // writes through delta_pwrite, fallbacks included
+    uint64_t delta_fallbacks;  // of those, sent whole: cached copy missing or stale
+    uint64_t delta_bytes_sent; // bytes actually written by delta writes
+    uint64_t delta_bytes_saved; // bytes of delta writes skipped as unchanged
+    uint64_t dedup_refs;          // cached blocks sharing a deduplicated payload
+    uint64_t dedup_unique;        // distinct payloads they share
+    uint64_t dedup_logical_bytes; // bytes those blocks hold (ratio = logical / stored)
+    uint64_t dedup_stored_bytes;  // bytes of the distinct payloads
+    uint64_t partial_fills; // put_range() calls that cached sub-blocks of a block
+    uint64_t partial_hits;  // blocks read() served (in part) from their sub-blocks
+};
+
+// Counters of one cache partition (cache_get_partition_stats)
+struct CachePartitionStats {
+    uint64_t budget_bytes;   // share of the capacity reserved for it
+    uint64_t resident_bytes; // slot memory its blocks hold
+    uint64_t borrowed_bytes; // of those, held beyond its budget
+    uint64_t hits;           // blocks served to its files by read()
+    uint64_t misses;         // read() of its files stopped at a missing block
+};
 
-// Ring Buffer Cache
+// How hard trim() sheds memory. Blocks are dropped in eviction order;
+// pinned and loading blocks are never dropped.
+enum CacheTrimLevel {
+    kTrimFreeSlots = 0, // only return memory of slots holding no block
+    kTrimModerate = 1,  // keep at most half of the capacity
+    kTrimLow = 2,       // keep at most a quarter of the capacity
+    kTrimComplete = 3,  // drop every block that can be dropped
+};
+
+// Sharded block cache. Eviction is pluggable (LRU or S3-FIFO, chosen at
+// init) and each partition keeps its own eviction order.
 class BlockCache {
+    struct Shard;
+
 public:
+    // Read-only lease on a cached block. While a Pin is alive the block can
+    // neither be evicted nor have its slot reused, so data() may be handed
+    // to consumers without copying. Unpins on destruction.
+    class Pin {
+    public:
+        Pin() = default;
+        Pin(Pin&& other) noexcept { *this = std::move(other); }
+        Pin& operator=(Pin&& other) noexcept;
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+        ~Pin() { reset(); }
+
+        explicit operator bool() const { return data_ != nullptr; }
+        const uint8_t* data() const { return data_; }
+        size_t size() const { return size_; }
+        void reset();
+
+    private:
+        friend class BlockCache;
+        Shard* shard_ = nullptr;
+        uint32_t slot_ = UINT32_MAX;
+        const uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // Outcome of claim_block
+    enum ClaimResult {
+        kClaimed = 0,  // caller must fetch, then complete_block or fail_block
+        kPresent = 1,  // block is already cached
+        kInFlight = 2, // another caller is fetching it, wait_for_block instead
+    };
+
     static BlockCache& instance();
 
-    void init(size_t capacity_mb);
+    // policy selects the replacement policy used by every shard; S3-FIFO
+    // keeps one-pass scans (e.g. streaming a disc image) from flushing the
+    // hot working set. Slot memory is committed lazily as slots fill. Calling
+    // init again resizes; the shard count and policy stay as first set.
+    void init(size_t capacity_mb, EvictionPolicyType policy = kEvictLru);
+    EvictionPolicyType policy() const { return policy_type_; }
+
+    // Grow or shrink the cache at runtime. Shrinking evicts unpinned blocks
+    // right away and returns their memory to the OS; pinned or loading blocks
+    // over the new budget go as soon as they are released. Returns false if
+    // the cache is not initialized or capacity_mb is 0.
+    bool resize(size_t capacity_mb);
+    size_t capacity_mb() const;
+
+    // --- Partitions ---
+    // Consumers (the VFS running a game, a media scan, ...) can get their own
+    // share of the capacity, so one cannot evict the other's working set.
+    // Each partition has a budget and its own eviction order; blocks are
+    // charged to the partition of their file. Partition 0 is the default
+    // and gets whatever the named partitions leave. A partition that may
+    // borrow fills idle capacity beyond its budget; borrowed slots are the
+    // first reclaimed when a partition under its budget needs room.
+    static constexpr int kMaxPartitions = 8;
+    // Create the named partition, or update its budget and borrowing.
+    // Returns its id, or -1 if all partitions are in use. May be called
+    // before init.
+    int create_partition(const std::string& name, size_t capacity_mb, bool borrow);
+    // Charge the file's blocks cached from now on to partition (0: default)
+    void set_file_partition(uint64_t file_id, int partition);
+    bool partition_stats(int partition, CachePartitionStats* out);
+
+    // Derive a stable file identity from the NFS fsid and fileid (as
+    // reported by nfs_fstat64 in nfs_dev / nfs_ino). Never returns 0.
+    static uint64_t make_file_id(uint64_t fsid, uint64_t fileid);
     
     // Copy data from cache to output buffer.
-    // Returns bytes read if some blocks are present.
-    // Returns -1 if any blocks are missing and we should wait.
+    // Returns bytes read if some blocks are present; the count is exact at
+    // end of file, and 0 if offset is at or past a known EOF.
+    // Returns -1 if the first block is missing and we should wait.
     // out_actual_len: actually copied bytes if partial is okay.
-    int read(uint64_t offset, size_t len, uint8_t* out_buffer, size_t* out_actual_len = nullptr);
+    int read(uint64_t file_id, uint64_t offset, size_t len, uint8_t* out_buffer, size_t* out_actual_len = nullptr);
+
+    // Pin a cached block for zero-copy access. Returns an empty Pin on miss.
+    Pin pin_block(uint64_t file_id, uint64_t block_id);
+    // Slots held by pins, retired ones included: not available to new blocks
+    size_t pinned_blocks() const;
+
+    // Check if a block is cached, without affecting its recency
+    bool contains(uint64_t file_id, uint64_t block_id);
+
+    // Put data into a specific block. Also completes an outstanding claim.
+    // len < BLOCK_SIZE marks the block as the file's tail and sets its EOF.
+    void put_block(uint64_t file_id, uint64_t block_id, const uint8_t* data, size_t len);
+
+    // Cache the whole sub-blocks within len bytes of data at offset (the
+    // file's last one counts as whole up to a known EOF), e.g. what a small
+    // synchronous read brought in. Blocks covered entirely are published as
+    // by complete_block; the others are kept partial. read() serves the
+    // sub-blocks a partial block holds, while block-level calls (claim_block,
+    // pin_block, wait_for_block, contains) treat it as missing until it is
+    // filled up or fetched whole.
+    void put_range(uint64_t file_id, uint64_t offset, const uint8_t* data, size_t len);
+
+    // Fetch size for the file: readers round misses out to aligned extents
+    // of this many bytes (a multiple of SUB_BLOCK_SIZE, at most
+    // kMaxExtent), e.g. the server's readmax for one READ per extent. 0
+    // (the default) fetches what was asked.
+    static constexpr size_t kMaxExtent = 8 * 1024 * 1024;
+    void set_file_extent(uint64_t file_id, size_t bytes);
+    size_t file_extent(uint64_t file_id);
+
+    // Single-flight fetching: at most one claim per block is outstanding.
+    // A claimed block is "in flight" until the claimant calls complete_block
+    // (publishes the data and wakes waiters) or fail_block (drops the claim
+    // and wakes waiters so they can fetch on their own).
+    ClaimResult claim_block(uint64_t file_id, uint64_t block_id);
+    void complete_block(uint64_t file_id, uint64_t block_id, const uint8_t* data, size_t len);
+    void fail_block(uint64_t file_id, uint64_t block_id);
+    // out_age_us, if given: time since the block was claimed
+    bool in_flight(uint64_t file_id, uint64_t block_id, uint64_t* out_age_us = nullptr);
+
+    // Zero-copy completion of a claim: the slot reserved by claim_block,
+    // BLOCK_SIZE writable bytes for the claimant to READ into directly, or
+    // nullptr if the claim got no slot (fetch into a buffer of your own and
+    // complete_block). Other writers leave the block alone from then on.
+    // Readers see nothing until commit_block publishes len valid bytes;
+    // fail_block drops them instead.
+    uint8_t* claim_buffer(uint64_t file_id, uint64_t block_id);
+    void commit_block(uint64_t file_id, uint64_t block_id, size_t len);
+
+    // End of file as last reported by set_file_size (e.g. from fstat after
+    // open, or a write extending the file) or learned from a short block.
+    // Reads never return bytes past it.
+    void set_file_size(uint64_t file_id, uint64_t size);
+    bool file_size(uint64_t file_id, uint64_t* out_size);
+
+    // Change attribute of a file's current contents (see make_change_attr).
+    // Disk tier entries are keyed by it; 0 (unknown) bypasses the disk tier.
+    static uint64_t make_change_attr(uint64_t size, uint64_t mtime_sec, uint64_t mtime_nsec);
+    void set_file_change(uint64_t file_id, uint64_t change);
+    uint64_t file_change(uint64_t file_id);
+    // Record the change attribute seen when (re)opening the file. If it
+    // differs from the one recorded before, the file was modified elsewhere
+    // and everything cached for it is invalidated. Returns true if it was.
+    // Ignored while the file has dirty blocks.
+    bool revalidate(uint64_t file_id, uint64_t change);
+
+    // --- Invalidation ---
+    // Every cached block carries the generation of its file at the time it
+    // was cached. Bumping the generation makes all of them stale at once;
+    // stale blocks are dropped when next looked up, or age out.
+
+    // Drop everything cached for the file in O(1), including dirty blocks
+    // not written back and its EOF. Disk tier entries are left behind but
+    // no longer match.
+    void invalidate_file(uint64_t file_id);
+    // Drop the blocks overlapping [offset, offset + len). Ranges spanning
+    // more blocks than the cache holds invalidate the file's generation
+    // instead, keeping only dirty blocks outside the range.
+    void invalidate_range(uint64_t file_id, uint64_t offset, uint64_t len);
+
+    // Add a persistent disk tier in dir, bounded to capacity_mb (rounded
+    // down to whole segments, see DiskCache::open). Completed blocks are
+    // written through to it; RAM misses and claims are served from it when
+    // possible, promoting the block back into RAM. Can be enabled once;
+    // returns false if already enabled, dir is unusable or capacity_mb is
+    // too small to hold two blocks.
+    bool enable_disk_cache(const std::string& dir, size_t capacity_mb);
+
+    // --- Write-back ---
+    // Dirty blocks hold writes the server has not seen yet. They are never
+    // evicted, trimmed or compressed until written back; only invalidation
+    // (or discard_dirty) drops them.
+
+    // A run of dirty bytes to write back with one WRITE, spanning one or
+    // more adjacent blocks
+    struct DirtyExtent {
+        uint64_t offset = 0;
+        std::vector<uint8_t> data;
+        std::vector<std::pair<uint64_t, uint32_t>> blocks; // (block_id, write seq) covered
+    };
+
+    // Apply len bytes at off within a block. The block must be cached, or the
+    // write must replace all of its data up to EOF; otherwise returns false
+    // and the caller has to bring in the old contents first (claim and fetch
+    // it). Writes may not start past EOF. Without dirty this updates the
+    // cached copy of a write already sent to the server; with dirty the
+    // write is deferred until collect_dirty / mark_clean. Extends EOF. A
+    // pinned block is written to a fresh copy: Pins keep what they saw.
+    bool write_block(uint64_t file_id, uint64_t block_id, size_t off, const uint8_t* data, size_t len, bool dirty);
+
+    // Update the cached copy after len bytes at offset were written to the
+    // server: cached blocks are patched, the rest dropped. Extends EOF.
+    void write_through(uint64_t file_id, uint64_t offset, const uint8_t* data, size_t len);
+
+    // A byte range of a write, relative to the write's start
+    struct WriteRange {
+        size_t offset;
+        size_t len;
+    };
+
+    // Compare a write of len bytes at offset with the cached copy and return
+    // the ranges that differ, in 512-byte granules, merging unchanged gaps
+    // shorter than min_gap. Bytes past EOF count as changed. False if a
+    // block below EOF is not cached, is dirty or is being fetched: the
+    // cached copy cannot stand in for the server's, so write everything.
+    bool diff_cached(uint64_t file_id, uint64_t offset, const uint8_t* data, size_t len, size_t min_gap,
+                     std::vector<WriteRange>* out);
+    // Account a delta write of len bytes of which sent were written
+    void record_delta_write(size_t len, size_t sent, bool fell_back);
+
+    // Snapshot the file's dirty bytes in offset order. Adjacent dirty blocks
+    // are merged (with the clean bytes between them) into one extent until it
+    // reaches max_bytes.
+    std::vector<DirtyExtent> collect_dirty(uint64_t file_id, size_t max_bytes);
+    // The extent reached the server: its blocks become clean and evictable,
+    // except those written again since collect_dirty.
+    void mark_clean(uint64_t file_id, const DirtyExtent& extent);
+    // Drop the file's dirty blocks unwritten. Returns how many were dropped.
+    size_t discard_dirty(uint64_t file_id);
+    bool has_dirty(uint64_t file_id);
+    // Files whose oldest write not yet written back is at least min_age old
+    std::vector<uint64_t> dirty_files(std::chrono::milliseconds min_age);
+    size_t dirty_bytes() const;
+    // Copy the dirty bytes within [offset, offset + len) over buf, which
+    // holds that range as read from the server
+    void overlay_dirty(uint64_t file_id, uint64_t offset, uint8_t* buf, size_t len);
+    // Called (without locks held) by trim at kTrimModerate and above while
+    // blocks are dirty, to write them back so they can be dropped
+    void set_flush_handler(void (*handler)());
 
-    // Get direct pointer to a block (for single block reads/fills)
-    // Be careful with lifetime.
-    uint8_t* get_block_ptr(uint64_t block_id);
+    // Keep blocks evicted from the slots LZ-compressed in a secondary pool of
+    // up to budget_mb, on top of the capacity, and decompress them on a later
+    // miss instead of fetching again. Blocks dropped by resize or trim are
+    // not kept. 0 disables the pool and frees it. May be called before init.
+    void enable_compressed_cache(size_t budget_mb);
+    // Share one copy of blocks with identical contents across files and
+    // offsets (see DedupStore). Applies to blocks cached from now on; costs
+    // a hash of every fetched block and a compare when it matches. Off by
+    // default.
+    void enable_dedup(bool enabled) { dedup_.set_enabled(enabled); }
 
-    // Put data into a specific block
-    void put_block(uint64_t block_id, const uint8_t* data, size_t len);
+    // Takes every shard lock briefly to sum resident memory
+    BlockCacheStats stats();
+
+    // Respond to memory pressure: drop blocks down to the level's target and
+    // return the freed pages to the OS. Capacity is unchanged, so the cache
+    // refills on demand afterwards. Returns the bytes released.
+    size_t trim(CacheTrimLevel level);
 
     // Invalidate a block (e.g. after write)
-    void invalidate_block(uint64_t block_id);
+    void invalidate_block(uint64_t file_id, uint64_t block_id);
+
+    // Wait for a block to become available or timeout. Returns early (false)
+    // if the fetch in flight when the wait started fails. Waiters are woken
+    // only by events on their own block, after an optional short spin.
+    bool wait_for_block(uint64_t file_id, uint64_t block_id, int timeout_ms);
+    bool wait_for_block_us(uint64_t file_id, uint64_t block_id, uint32_t timeout_us);
 
-    // Wait for a block to become available or timeout
-    bool wait_for_block(uint64_t block_id, int timeout_ms);
+    // Upper bound for the adaptive spin before a waiter parks. 0 disables
+    // spinning (waiters park immediately).
+    void set_wait_spin_limit_us(uint32_t limit_us);
 
 private:
     BlockCache() = default;
 
-    struct Slot {
-        uint8_t data[BLOCK_SIZE];
-        uint64_t block_id = 0;
+    static constexpr uint32_t kNil = UINT32_MAX;
+    static constexpr uint32_t kAllPages = UINT32_MAX;
+    static constexpr uint32_t kMaxShards = 16;
+    static constexpr size_t kMinSlotsPerShard = 8;
+    static constexpr uint32_t kDefaultSpinLimitUs = 100;
+
+    // Per-slot bookkeeping, kept apart from the 128KB payloads so that
+    // lookups and eviction only touch this compact array.
+    struct SlotMeta {
+        BlockKey key = {0, 0};
+        uint32_t valid_len = 0; // bytes of real data; < BLOCK_SIZE only for a file's tail
+        uint32_t pins = 0;    // pinned slots are kept off the eviction policy
+        uint32_t generation = 0; // of the file when cached; stale once it moves on
+        uint32_t write_seq = 0; // bumped by every write_block
+        uint32_t dirty_lo = 0;  // byte range not yet written back, if dirty
+        uint32_t dirty_hi = 0;
+        uint8_t partition = 0;  // charged for the slot, owns its eviction order
+        uint32_t pages = kAllPages; // sub-blocks holding data; all set once complete
+        uint32_t shared = DedupStore::kNil; // DedupStore payload in place of the slot's own
+        uint8_t* shared_data = nullptr;    // its memory, read-only
         bool valid = false;
-        uint64_t last_access = 0;
+        bool dirty = false;   // dirty slots are kept off the eviction policy too
+        bool loading = false; // claimed, mapped but invisible to readers
+        bool filling = false; // loading in place through claim_buffer
+        bool retired = false; // invalidated while pinned or loading, freed on
+                              // last unpin / when the fetch completes
+        std::chrono::steady_clock::time_point claimed_at; // while loading
+    };
+
+    // A DedupStore reference taken before a shard's lock, so the lookup,
+    // compare and copy do not stall the shard. Shard::share hands it to a
+    // slot; released on scope exit if unused. Declare it before the lock.
+    class SharedPayload {
+    public:
+        explicit SharedPayload(DedupStore& store) : store_(store) {}
+        SharedPayload(const SharedPayload&) = delete;
+        SharedPayload& operator=(const SharedPayload&) = delete;
+        ~SharedPayload() {
+            if (id_ != DedupStore::kNil) store_.release(id_);
+        }
+
+        // Reference the payload equal to len bytes of data, if dedup is on
+        void acquire(const uint8_t* data, size_t len);
+
+    private:
+        friend struct Shard;
+        DedupStore& store_;
+        uint32_t id_ = DedupStore::kNil;
+        uint8_t* data_ = nullptr;
     };
 
-    std::vector<std::unique_ptr<Slot>> slots_;
-    std::unordered_map<uint64_t, int> id_to_slot_; // block_id -> slot_index
-    std::mutex mutex_;
-    std::condition_variable cv_;
-    std::mutex cv_mutex_; // Dedicated mutex for CV if needed, but we can reuse mutex_
-    size_t capacity_slots_ = 0;
-    uint64_t access_counter_ = 0;
+    // Waiters parked on one block. Created by the first waiter, removed by
+    // the last one to leave.
+    struct WaitQueue {
+        std::condition_variable cv;
+        uint32_t waiters = 0;
+    };
+
+    // A partition's slice of one shard
+    struct ShardPartition {
+        size_t budget = 0; // slots it may fill without borrowing
+        size_t live = 0;   // slots it holds, pinned and loading ones included
+        bool borrow = true;
+        double share = 0;  // of the capacity, for named partitions
+        std::unique_ptr<EvictionPolicy> policy; // null while unused
+    };
+
+    // An independent slice of the cache: its own lock, map, eviction policy,
+    // waiters and payload storage. Blocks are routed to shards by key hash.
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<BlockKey, std::unique_ptr<WaitQueue>, BlockKeyHash> waiters;
+        // Bumped on every publish/fail so spinning waiters can poll without
+        // taking the lock.
+        std::atomic<uint64_t> publish_seq{0};
+        std::unordered_map<BlockKey, uint32_t, BlockKeyHash> key_to_slot; // (file, block) -> slot_index
+        std::vector<SlotMeta> meta; // one per slot index ever made available
+        SlabArena arena{BLOCK_SIZE};
+        std::vector<uint32_t> free_slots; // stack of never used / invalidated slots
+        size_t capacity = 0; // max slots holding blocks; may be < meta.size() after a shrink
+        std::atomic<size_t> dirty_blocks{0}; // changed under mutex, read without it
+        std::atomic<size_t> pinned_slots{0}; // likewise
+        // Each partition orders its ready, unpinned slots for eviction
+        ShardPartition parts[kMaxPartitions];
+        // Victims of acquire_slot, compressed (when enabled)
+        CompressedPool compressed{BLOCK_SIZE};
+        // Victims copied out for the pool, compressed once the lock is
+        // dropped (see compress_evicted)
+        struct Evicted {
+            BlockKey key;
+            uint32_t generation;
+            uint32_t len;
+            std::unique_ptr<uint8_t[]> data;
+        };
+        std::vector<Evicted> evicted;
+        std::atomic<size_t> evicted_count{0}; // evicted.size(), read without mutex
+        DedupStore* dedup = nullptr; // the cache's, set by init
+
+        void init(size_t slots, EvictionPolicyType policy_type);
+        // Split capacity into partition budgets after a change of shares or
+        // capacity. Named partitions get their share, the default the rest.
+        void rebudget();
+        // Set capacity, adding slot indices when growing and evicting when
+        // shrinking. Returns bytes released to the OS.
+        size_t resize(size_t slots);
+        // Evict down to target blocks, then return the memory of free slots
+        // to the OS, except the ones still refillable under capacity if
+        // keep_refillable. Returns bytes released.
+        size_t shed(size_t target, bool keep_refillable);
+        // Only valid for slots returned by acquire_slot (their slab is mapped)
+        // Block memory; read-only while the slot shares a deduplicated payload
+        uint8_t* payload(uint32_t slot) {
+            return meta[slot].shared_data ? meta[slot].shared_data : arena.slot(slot);
+        }
+        // Point slot at the acquired payload, which it now owns, and release
+        // its own memory. False if nothing was acquired.
+        bool share(uint32_t slot, SharedPayload& payload);
+        // Writable block memory, copying a shared payload into the slot's
+        // own first. nullptr if memory cannot be mapped or the shared
+        // payload is pinned.
+        uint8_t* make_private(uint32_t slot);
+        // Drop the slot's reference to a shared payload, if any
+        void unshare(uint32_t slot);
+        size_t live() const { return meta.size() - free_slots.size(); }
+
+        // Returns a free slot charged to partition, evicting a victim (set
+        // aside for the compressed pool) if needed: its own, or one a
+        // partition holds beyond its budget. kNil if capacity is 0, memory cannot be mapped
+        // or every candidate slot is pinned / loading.
+        uint32_t acquire_slot(uint32_t partition);
+        // Victim for acquire_slot(partition), untracked. kNil if none.
+        uint32_t pick_victim(uint32_t partition);
+        // Victim of the partition furthest over its budget (beyond_budget),
+        // or of the one holding the most slots. kNil if none has one.
+        uint32_t pick_from_largest(bool beyond_budget);
+        EvictionPolicy* policy_of(uint32_t slot) { return parts[meta[slot].partition].policy.get(); }
+        // Move key's block from the compressed pool into a slot. Returns the
+        // slot, or kNil if key is mapped already or not in the pool.
+        uint32_t promote(const BlockKey& key, uint32_t partition);
+        // Drop key's block (and compressed copy) if it is older than the
+        // file's current generation. Dirty blocks are unwritten data newer
+        // than any generation; they are moved to the current one instead.
+        void expire(const BlockKey& key, uint32_t generation);
+        void release_slot(uint32_t slot);
+        // Unmap key: free its slot now, or retire it if pinned or loading.
+        // Also drops a compressed copy. False if key was in neither.
+        bool drop(const BlockKey& key);
+        // Evict the policy's victim and free its slot. False if none is evictable.
+        bool evict_one();
+
+        void pin(uint32_t slot);
+        void unpin(uint32_t slot);
+
+        // Slot holding the ready, complete block for key, or kNil
+        uint32_t find_ready(const BlockKey& key) const;
+        // Slot of a ready block holding only some of its sub-blocks, or kNil
+        uint32_t find_partial(const BlockKey& key) const;
+        // Bytes of a partial block held contiguously from offset from, up
+        // to want
+        size_t held_bytes(uint32_t slot, size_t from, size_t want) const;
+        // Like find_ready, but treats a short tail that ends before eof as absent
+        uint32_t find_current(const BlockKey& key, uint64_t eof) const;
+        bool is_loading(const BlockKey& key) const;
+
+        // Wake waiters of key only. Caller holds mutex.
+        void notify(const BlockKey& key);
+    };
+
+    struct Counters {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> fetch_claims{0};
+        std::atomic<uint64_t> dedup_present{0};
+        std::atomic<uint64_t> dedup_inflight{0};
+        std::atomic<uint64_t> fetch_failures{0};
+        std::atomic<uint64_t> trimmed_bytes{0};
+        std::atomic<uint64_t> absorbed_writes{0};
+        std::atomic<uint64_t> flush_writes{0};
+        std::atomic<uint64_t> flushed_bytes{0};
+        std::atomic<uint64_t> delta_writes{0};
+        std::atomic<uint64_t> delta_fallbacks{0};
+        std::atomic<uint64_t> delta_bytes_sent{0};
+        std::atomic<uint64_t> delta_bytes_saved{0};
+        std::atomic<uint64_t> partial_fills{0};
+        std::atomic<uint64_t> partial_hits{0};
+    };
 
-    int evict_lru();
+    Shard& shard_for(const BlockKey& key) {
+        size_t h = BlockKeyHash()(key);
+        return shards_[(h ^ (h >> 29)) % shard_count_.load(std::memory_order_relaxed)];
+    }
+
+    // Per-file state shared by all shards. files_mutex_ and shard mutexes
+    // are never held together.
+    struct FileInfo {
+        uint64_t size = 0;
+        bool size_known = false;
+        uint64_t change = 0;
+        uint32_t generation = 0;
+        uint32_t partition = 0;
+        size_t extent = 0; // fetch size, see set_file_extent
+        // Blocks made dirty since last written back; may include blocks
+        // dropped since, which collect_dirty prunes
+        std::set<uint64_t> dirty;
+        std::chrono::steady_clock::time_point dirty_since;
+    };
+
+    struct PartitionConfig {
+        std::string name;
+        size_t capacity_mb = 0;
+        bool borrow = true;
+        bool used = false;
+    };
+
+    struct PartitionCounters {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+    };
+
+    Shard shards_[kMaxShards];
+    std::atomic<uint32_t> shard_count_{1};
+    std::mutex init_mutex_;
+    std::atomic<size_t> capacity_slots_{0};
+    size_t compressed_budget_ = 0; // bytes over all shards, under init_mutex_
+    std::unique_ptr<DiskCache> disk_owner_;
+    std::atomic<DiskCache*> disk_{nullptr};
+    std::atomic<void (*)()> flush_handler_{nullptr};
+    std::mutex files_mutex_;
+    std::unordered_map<uint64_t, FileInfo> files_;
+    EvictionPolicyType policy_type_ = kEvictLru;
+    PartitionConfig partitions_[kMaxPartitions]; // under init_mutex_; [0], the default, stays unused
+    Counters counters_;
+    PartitionCounters partition_counters_[kMaxPartitions];
+    DedupStore dedup_{BLOCK_SIZE};
+    std::atomic<uint32_t> spin_limit_us_{kDefaultSpinLimitUs};
+    std::atomic<uint32_t> spin_budget_us_{kDefaultSpinLimitUs / 4};
+
+    void adapt_spin(bool resolved_while_spinning, uint64_t waited_us);
+
+    // Compress the victims acquire_slot set aside in shard and add them to
+    // its pool. Caller holds no shard lock.
+    void compress_evicted(Shard& shard);
+    // Runs compress_evicted when it goes out of scope. Declared before the
+    // shard's lock, so it runs once the lock is released.
+    class EvictedFlush {
+    public:
+        EvictedFlush(BlockCache& cache, Shard& shard) : cache_(cache), shard_(shard) {}
+        EvictedFlush(const EvictedFlush&) = delete;
+        EvictedFlush& operator=(const EvictedFlush&) = delete;
+        ~EvictedFlush() {
+            if (shard_.evicted_count.load(std::memory_order_relaxed) != 0) cache_.compress_evicted(shard_);
+        }
+
+    private:
+        BlockCache& cache_;
+        Shard& shard_;
+    };
+
+    // Current generation of the file; its EOF goes to *eof if known, its
+    // partition to *partition
+    uint32_t file_generation(uint64_t file_id, uint64_t* eof = nullptr, uint32_t* partition = nullptr);
+    // Give shard the partitions' shares of total_slots and their borrowing,
+    // creating missing policies. Caller holds init_mutex_ and shard's mutex,
+    // and rebudgets the shard.
+    void configure_partitions(Shard& shard, size_t total_slots);
+    // Change attribute keying the file's disk tier entries, folding in the
+    // generation so invalidated blocks are not read back. 0 if unknown.
+    uint64_t disk_change(uint64_t file_id);
+    // Move the file to a new generation. Dirty blocks within [first, last]
+    // are dropped, the rest survive (see Shard::expire).
+    void bump_generation(uint64_t file_id, uint64_t first, uint64_t last);
+
+    // complete_block; persist writes the block through to the disk tier
+    void publish(uint64_t file_id, uint64_t block_id, const uint8_t* data, size_t len, bool persist);
+    // Promote key from the disk tier into RAM. True if it is now cached.
+    bool load_from_disk(const BlockKey& key);
 };
 
 extern "C" {
     void cache_init(int capacity_mb); // e.g. 64 or 128
+    // policy: 0 = LRU, 1 = S3-FIFO (scan resistant). See EvictionPolicyType.
+    void cache_init_with_policy(int capacity_mb, int policy);
+    // Grow or shrink an initialized cache. Returns 0, or -1 if not initialized.
+    int cache_resize(int capacity_mb);
+    // Shed memory under pressure; level is a CacheTrimLevel (0-3).
+    // Returns the bytes released to the OS.
+    int64_t cache_trim(int level);
+    uint64_t cache_make_file_id(uint64_t fsid, uint64_t fileid);
+
+    // Per-file API: blocks are keyed by (file_id, block_id)
+    int cache_file_read(uint64_t file_id, uint64_t offset, int len, uint8_t* out_ptr);
+    void cache_file_put(uint64_t file_id, uint64_t block_id, const uint8_t* data, int len);
+    int cache_file_has_block(uint64_t file_id, uint64_t block_id);
+    // Cache the whole 4KB sub-blocks of len bytes read at offset
+    void cache_file_put_range(uint64_t file_id, uint64_t offset, const uint8_t* data, int len);
+    // Fetch extent in bytes for the file's misses; 0 fetches what was asked
+    void cache_file_set_extent(uint64_t file_id, int bytes);
+    // Record a file's size; -1 from cache_file_size means unknown
+    void cache_file_set_size(uint64_t file_id, uint64_t size);
+    int64_t cache_file_size(uint64_t file_id);
+    uint64_t cache_make_change_attr(uint64_t size, uint64_t mtime_sec, uint64_t mtime_nsec);
+    void cache_file_set_change(uint64_t file_id, uint64_t change);
+    // Like cache_file_set_change, but invalidates the file if its change
+    // attribute moved. Returns 1 if it did.
+    int cache_file_revalidate(uint64_t file_id, uint64_t change);
+    // Drop a file's cached blocks: all of them, or those overlapping a range
+    void cache_file_invalidate(uint64_t file_id);
+    void cache_file_invalidate_range(uint64_t file_id, uint64_t offset, uint64_t len);
+    // Enable the persistent disk tier. Returns 0, or -1 on failure.
+    int cache_enable_disk(const char* dir, int capacity_mb);
+    // Size the compressed in-memory pool; 0 disables it
+    void cache_enable_compression(int budget_mb);
+    // Share identical blocks across files (see BlockCache::enable_dedup)
+    void cache_enable_dedup(int enabled);
+    // Create or update a named partition (see BlockCache::create_partition).
+    // Returns its id, or -1 if none is left.
+    int cache_create_partition(const char* name, int capacity_mb, int borrow);
+    void cache_file_set_partition(uint64_t file_id, int partition);
+    // Returns 0, or -1 for an unknown partition
+    int cache_get_partition_stats(int partition, CachePartitionStats* out);
+
+    // Single-flight fetch protocol, see BlockCache::claim_block.
+    // Returns 0 = claimed (fetch it), 1 = already cached, 2 = in flight.
+    int cache_file_claim(uint64_t file_id, uint64_t block_id);
+    void cache_file_complete(uint64_t file_id, uint64_t block_id, const uint8_t* data, int len);
+    void cache_file_fail(uint64_t file_id, uint64_t block_id);
+    // Slot memory to READ a claimed block into (NULL: use cache_file_complete),
+    // then published with cache_file_commit or dropped with cache_file_fail
+    uint8_t* cache_file_claim_buffer(uint64_t file_id, uint64_t block_id);
+    void cache_file_commit(uint64_t file_id, uint64_t block_id, int len);
+
+    void cache_get_stats(BlockCacheStats* out);
+    void cache_set_wait_spin_us(int limit_us);
+
+    // Zero-copy access: returns an opaque pin handle (NULL on miss) and the
+    // block's read-only memory, valid until cache_unpin_block(handle).
+    void* cache_pin_block(uint64_t file_id, uint64_t block_id, const uint8_t** out_data, int* out_len);
+    void cache_unpin_block(void* pin);
+
+    // Legacy single-file API, operates on file_id 0
     int cache_read(uint64_t offset, int len, uint8_t* out_ptr);
     void cache_put(uint64_t block_id, const uint8_t* data, int len);
     // Check if block exists (to decide whether to fetch)
@@ -0,0 +1,26 @@
+#ifndef BLOCK_KEY_HPP
+#define BLOCK_KEY_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Identity of a cached block: which file, and which BLOCK_SIZE block in it.
+// file_id 0 is the anonymous file used by the legacy single-file C API.
+struct BlockKey {
+    uint64_t file_id;
+    uint64_t block_id;
+
+    bool operator==(const BlockKey& other) const {
+        return file_id == other.file_id && block_id == other.block_id;
+    }
+};
+
+struct BlockKeyHash {
+    size_t operator()(const BlockKey& key) const {
+        uint64_t h = key.file_id * 0x9E3779B97F4A7C15ULL;
+        h ^= key.block_id + 0x7F4A7C159E3779B9ULL + (h << 6) + (h >> 2);
+        return static_cast<size_t>(h);
+    }
+};
+
+#endif // BLOCK_KEY_HPP
@@ -0,0 +1,231 @@
+#include "cache_preload.hpp"
+#include <nfsc/libnfs.h>
+#include <algorithm>
+#include <deque>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(__APPLE__) || defined(__GNUC__)
+#define EXPORT __attribute__((visibility("default"))) __attribute__((used))
+#else
+#define EXPORT
+#endif
+
+static const int kMaxParallelism = 32;
+static const int kMaxAttempts = 3;     // per block, for failed READs or lost pins
+static const int kRpcTimeoutMs = 10000;
+
+// One READ slot; at most parallelism of them are in flight
+struct CachePreload::Request {
+    std::vector<uint8_t> buffer = std::vector<uint8_t>(BLOCK_SIZE);
+    uint64_t block = 0;
+    size_t expected = 0;
+    int status = 0;
+    bool busy = false;     // issued, not processed yet
+    bool finished = false; // callback ran
+};
+
+void CachePreload::on_read(int status, struct nfs_context* /*nfs*/, void* /*data*/, void* private_data) {
+    auto* req = static_cast<Request*>(private_data);
+    req->status = status;
+    req->finished = true;
+}
+
+CachePreload::CachePreload(const std::string& server, const std::string& export_path, const std::string& path,
+                           uint64_t offset, uint64_t len, int parallelism)
+    : server_(server), export_path_(export_path), path_(path), offset_(offset), len_(len),
+      parallelism_(std::max(1, std::min(parallelism, kMaxParallelism))) {
+    worker_ = std::thread(&CachePreload::run, this);
+}
+
+CachePreload::~CachePreload() {
+    cancel_ = true;
+    if (worker_.joinable()) worker_.join();
+    pins_.clear();
+}
+
+uint64_t CachePreload::range_bytes(uint64_t b) const {
+    uint64_t lo = std::max(offset_, b * BLOCK_SIZE);
+    uint64_t hi = std::min(end_, (b + 1) * BLOCK_SIZE);
+    return hi > lo ? hi - lo : 0;
+}
+
+void CachePreload::run() {
+    std::vector<std::unique_ptr<Request>> requests;
+    for (int i = 0; i < parallelism_; ++i) requests.emplace_back(new Request());
+
+    bool ok = false;
+    struct nfsfh* fh = nullptr;
+    struct nfs_context* nfs = nfs_init_context();
+    if (nfs) {
+        nfs_set_timeout(nfs, kRpcTimeoutMs);
+        struct nfs_stat_64 st;
+        if (nfs_mount(nfs, server_.c_str(), export_path_.c_str()) != 0 ||
+            nfs_open(nfs, path_.c_str(), O_RDONLY, &fh) != 0 || nfs_fstat64(nfs, fh, &st) != 0) {
+            printf("[CachePreload] Cannot open %s:%s/%s: %s\n", server_.c_str(), export_path_.c_str(),
+                   path_.c_str(), nfs_get_error(nfs));
+        } else {
+            BlockCache& cache = BlockCache::instance();
+            uint64_t file_id = BlockCache::make_file_id(st.nfs_dev, st.nfs_ino);
+            if (!cache.has_dirty(file_id)) {
+                cache.revalidate(file_id, BlockCache::make_change_attr(st.nfs_size, st.nfs_mtime, st.nfs_mtime_nsec));
+                cache.set_file_size(file_id, st.nfs_size);
+            }
+            end_ = st.nfs_size;
+            if (len_ != 0 && offset_ < end_ && len_ < end_ - offset_) end_ = offset_ + len_;
+            uint64_t total = end_ > offset_ ? end_ - offset_ : 0;
+            uint64_t first = offset_ / BLOCK_SIZE;
+            uint64_t blocks = total == 0 ? 0 : (end_ - 1) / BLOCK_SIZE - first + 1;
+            total_bytes_ = total;
+            file_id_ = file_id;
+
+            // Blocks pinned already (other preloads, zero-copy readers) hold
+            // their slots until released
+            uint64_t capacity_blocks = cache.capacity_mb() * 1024 * 1024 / BLOCK_SIZE;
+            uint64_t pinned = cache.pinned_blocks();
+            uint64_t free_blocks = capacity_blocks > pinned ? capacity_blocks - pinned : 0;
+            if (blocks > free_blocks) {
+                printf("[CachePreload] %s: %llu blocks do not fit a cache of %llu with %llu pinned\n",
+                       path_.c_str(), (unsigned long long)blocks, (unsigned long long)capacity_blocks,
+                       (unsigned long long)pinned);
+            } else {
+                ok = blocks == 0 || load(nfs, fh, file_id, st.nfs_size, first, first + blocks - 1, requests);
+            }
+        }
+        if (fh) nfs_close(nfs, fh);
+        // Also cancels READs still in flight after a failure or cancellation
+        nfs_destroy_context(nfs);
+    }
+
+    // Claims whose READ never got processed must be released for others
+    uint64_t file_id = file_id_.load(std::memory_order_relaxed);
+    for (auto& req : requests) {
+        if (req->busy) BlockCache::instance().fail_block(file_id, req->block);
+    }
+    state_.store(cancel_ ? kCancelled : ok ? kDone : kFailed, std::memory_order_release);
+    fflush(stdout);
+}
+
+bool CachePreload::load(struct nfs_context* nfs, struct nfsfh* fh, uint64_t file_id, uint64_t size, uint64_t first,
+                        uint64_t last, std::vector<std::unique_ptr<Request>>& requests) {
+    BlockCache& cache = BlockCache::instance();
+    std::deque<uint64_t> queue;
+    for (uint64_t b = first; b <= last; ++b) queue.push_back(b);
+    std::unordered_map<uint64_t, int> attempts;
+    std::unordered_set<uint64_t> fetched; // completed by us, not pinned yet
+    int in_flight = 0;
+
+    auto retry = [&](uint64_t b) {
+        if (++attempts[b] >= kMaxAttempts) {
+            printf("[CachePreload] %s: giving up on block %llu\n", path_.c_str(), (unsigned long long)b);
+            return false;
+        }
+        queue.push_back(b);
+        return true;
+    };
+
+    while (!queue.empty() || in_flight > 0) {
+        if (cancel_.load(std::memory_order_relaxed)) return false;
+
+        // Pin what is cached, claim and issue READs for the rest. Blocks
+        // fetched by someone else go round again until they land.
+        for (size_t n = queue.size(); n > 0 && in_flight < parallelism_; --n) {
+            uint64_t b = queue.front();
+            queue.pop_front();
+            BlockCache::Pin pin = cache.pin_block(file_id, b);
+            if (pin) {
+                fetched.erase(b);
+                pins_.push_back(std::move(pin));
+                done_bytes_.fetch_add(range_bytes(b), std::memory_order_relaxed);
+                continue;
+            }
+            if (fetched.erase(b) != 0) {
+                // Our READ landed but the block is gone: the shard had no
+                // slot to keep it in (all pinned or loading)
+                if (!retry(b)) return false;
+                continue;
+            }
+            BlockCache::ClaimResult claim = cache.claim_block(file_id, b);
+            if (claim == BlockCache::kPresent) {
+                // Landed since pin_block; pinning fails repeatedly only when
+                // the cache is full of pinned blocks
+                if (!retry(b)) return false;
+                continue;
+            }
+            if (claim == BlockCache::kInFlight) {
+                queue.push_back(b);
+                continue;
+            }
+            auto it = std::find_if(requests.begin(), requests.end(), [](const std::unique_ptr<Request>& r) {
+                return !r->busy;
+            });
+            Request* req = it->get();
+            req->block = b;
+            req->expected = (size_t)std::min<uint64_t>(BLOCK_SIZE, size - b * BLOCK_SIZE);
+            req->finished = false;
+            if (nfs_pread_async(nfs, fh, req->buffer.data(), req->expected, b * BLOCK_SIZE, on_read, req) != 0) {
+                cache.fail_block(file_id, b);
+                printf("[CachePreload] %s: READ failed: %s\n", path_.c_str(), nfs_get_error(nfs));
+                return false;
+            }
+            req->busy = true;
+            in_flight++;
+        }
+
+        if (in_flight == 0) {
+            // Only blocks other fetchers are loading are left
+            cache.wait_for_block(file_id, queue.front(), 100);
+            continue;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = nfs_get_fd(nfs);
+        pfd.events = nfs_which_events(nfs);
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 100) < 0) continue;
+        if (nfs_service(nfs, pfd.revents) < 0) {
+            printf("[CachePreload] %s: connection failed: %s\n", path_.c_str(), nfs_get_error(nfs));
+            return false;
+        }
+
+        for (auto& req : requests) {
+            if (!req->busy || !req->finished) continue;
+            req->busy = false;
+            in_flight--;
+            if (req->status == (int)req->expected) {
+                cache.complete_block(file_id, req->block, req->buffer.data(), req->expected);
+                fetched.insert(req->block);
+                queue.push_front(req->block); // pin it next round
+            } else {
+                cache.fail_block(file_id, req->block);
+                if (!retry(req->block)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+extern "C" {
+    EXPORT void* cache_preload(const char* server, const char* export_path, const char* path, uint64_t offset,
+                               uint64_t len, int parallelism) {
+        if (!server || !export_path || !path) return nullptr;
+        return new CachePreload(server, export_path, path, offset, len, parallelism);
+    }
+
+    EXPORT int cache_preload_progress(void* handle, uint64_t* out_done, uint64_t* out_total) {
+        if (!handle) return CachePreload::kFailed;
+        auto* preload = static_cast<CachePreload*>(handle);
+        // Read the state first: once it is final, the counters are too
+        int state = preload->state();
+        if (out_done) *out_done = preload->done_bytes();
+        if (out_total) *out_total = preload->total_bytes();
+        return state;
+    }
+
+    EXPORT void cache_preload_release(void* handle) {
+        delete static_cast<CachePreload*>(handle);
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef CACHE_PRELOAD_HPP
+#define CACHE_PRELOAD_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "block_cache.hpp"
+
+// Loads a byte range of a file into BlockCache and pins it, for regions that
+// must never miss (ROM headers, a disc's TOC, BIOS images, boot data). Runs
+// on its own thread and NFS connection, with up to `parallelism` READs in
+// flight, and cooperates with other fetchers through claim_block. Blocks
+// stay pinned until the preload is destroyed.
+class CachePreload {
+public:
+    enum State {
+        kRunning = 0,
+        kDone = 1,     // the whole range is cached and pinned
+        kFailed = -1,  // see the log; blocks loaded so far stay pinned
+        kCancelled = -2,
+    };
+
+    // len 0 means up to EOF. parallelism is clamped to 1..32.
+    CachePreload(const std::string& server, const std::string& export_path, const std::string& path,
+                 uint64_t offset, uint64_t len, int parallelism);
+    // Cancels the preload if still running, then unpins its blocks
+    ~CachePreload();
+
+    CachePreload(const CachePreload&) = delete;
+    CachePreload& operator=(const CachePreload&) = delete;
+
+    State state() const { return state_.load(std::memory_order_acquire); }
+    // Bytes of the range cached and pinned so far
+    uint64_t done_bytes() const { return done_bytes_.load(std::memory_order_relaxed); }
+    // Size of the range, clipped to EOF; 0 until the file has been opened
+    uint64_t total_bytes() const { return total_bytes_.load(std::memory_order_relaxed); }
+    // BlockCache id of the file; 0 until it has been opened
+    uint64_t file_id() const { return file_id_.load(std::memory_order_relaxed); }
+
+private:
+    struct Request;
+    static void on_read(int status, struct nfs_context* nfs, void* data, void* private_data);
+
+    void run();
+    // Load and pin blocks [first, last] of file_id over nfs/fh, issuing
+    // READs through requests. False on failure or cancellation.
+    bool load(struct nfs_context* nfs, struct nfsfh* fh, uint64_t file_id, uint64_t size, uint64_t first,
+              uint64_t last, std::vector<std::unique_ptr<Request>>& requests);
+    // Bytes of block b within the range
+    uint64_t range_bytes(uint64_t b) const;
+
+    std::string server_;
+    std::string export_path_;
+    std::string path_;
+    uint64_t offset_;
+    uint64_t len_;
+    uint64_t end_ = 0; // range end, clipped to EOF
+    int parallelism_;
+
+    std::atomic<State> state_{kRunning};
+    std::atomic<bool> cancel_{false};
+    std::atomic<uint64_t> done_bytes_{0};
+    std::atomic<uint64_t> total_bytes_{0};
+    std::atomic<uint64_t> file_id_{0};
+    std::vector<BlockCache::Pin> pins_; // owned by the worker until joined
+    std::thread worker_;
+};
+
+extern "C" {
+    // Start preloading and pinning len bytes at offset of path on
+    // server:export_path (len 0: up to EOF), with at most parallelism READs
+    // in flight. Returns a handle for cache_preload_progress, to be passed
+    // to cache_preload_release, or NULL on bad arguments.
+    void* cache_preload(const char* server, const char* export_path, const char* path, uint64_t offset,
+                        uint64_t len, int parallelism);
+    // Returns the CachePreload::State; bytes done and total so far go to the
+    // out parameters when not NULL.
+    int cache_preload_progress(void* handle, uint64_t* out_done, uint64_t* out_total);
+    // Cancel the preload if still running and unpin its blocks
+    void cache_preload_release(void* handle);
+}
+
+#endif // CACHE_PRELOAD_HPP
@@ -0,0 +1,100 @@
+#include "compressed_pool.hpp"
+#include <chrono>
+#include <cstring>
+
+size_t CompressedPool::set_budget(size_t budget_bytes) {
+    budget_ = budget_bytes;
+    return shrink(budget_);
+}
+
+bool CompressedPool::compress(uint32_t generation, const uint8_t* data, size_t len, Blob* out) {
+    *out = Blob();
+    if (len == 0) return false;
+    // Codec state and output buffer of the calling thread
+    thread_local std::unique_ptr<lz::CompressState> state;
+    thread_local std::unique_ptr<uint8_t[]> scratch;
+    thread_local size_t scratch_size = 0;
+    if (!state) state.reset(new lz::CompressState());
+    if (scratch_size < len) {
+        scratch.reset(new uint8_t[len]);
+        scratch_size = len;
+    }
+
+    size_t size = lz::compress(state.get(), data, len, scratch.get(), len - len / 8);
+    if (size == 0) return false;
+    out->data.reset(new uint8_t[size]);
+    std::memcpy(out->data.get(), scratch.get(), size);
+    out->size = static_cast<uint32_t>(size);
+    out->valid_len = static_cast<uint32_t>(len);
+    out->generation = generation;
+    return true;
+}
+
+bool CompressedPool::insert(const BlockKey& key, Blob blob) {
+    if (budget_ == 0 || blob.valid_len > block_size_) return false;
+    erase(key);
+    if (!blob.data || blob.size > budget_) {
+        stats_.rejects++;
+        return false;
+    }
+    shrink(budget_ - blob.size);
+
+    stats_.stores++;
+    stats_.raw_bytes += blob.valid_len;
+    stats_.stored_bytes += blob.size;
+    stats_.resident_bytes += blob.size;
+    Entry& entry = entries_[key];
+    entry.blob = std::move(blob);
+    entry.order = order_.insert(order_.end(), key);
+    return true;
+}
+
+bool CompressedPool::store(const BlockKey& key, uint32_t generation, const uint8_t* data, size_t len) {
+    if (budget_ == 0 || len == 0 || len > block_size_) return false;
+    Blob blob;
+    compress(generation, data, len, &blob);
+    return insert(key, std::move(blob));
+}
+
+bool CompressedPool::take(const BlockKey& key, Blob* out) {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return false;
+    stats_.resident_bytes -= it->second.blob.size;
+    order_.erase(it->second.order);
+    *out = std::move(it->second.blob);
+    entries_.erase(it);
+    return true;
+}
+
+int CompressedPool::decompress(const Blob& blob, uint8_t* out) {
+    auto start = std::chrono::steady_clock::now();
+    int len = lz::decompress(blob.data.get(), blob.size, out, block_size_);
+    if (len != (int)blob.valid_len) return -1;
+    stats_.decompress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    stats_.hits++;
+    return len;
+}
+
+bool CompressedPool::erase(const BlockKey& key) {
+    Blob blob;
+    return take(key, &blob);
+}
+
+bool CompressedPool::erase_stale(const BlockKey& key, uint32_t generation) {
+    auto it = entries_.find(key);
+    if (it == entries_.end() || it->second.blob.generation == generation) return false;
+    return erase(key);
+}
+
+size_t CompressedPool::shrink(size_t target_bytes) {
+    size_t freed = 0;
+    while (stats_.resident_bytes > target_bytes && !order_.empty()) {
+        auto it = entries_.find(order_.front());
+        freed += it->second.blob.size;
+        stats_.resident_bytes -= it->second.blob.size;
+        entries_.erase(it);
+        order_.pop_front();
+    }
+    return freed;
+}
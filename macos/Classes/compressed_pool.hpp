@@ -0,0 +1,88 @@
+#ifndef COMPRESSED_POOL_HPP
+#define COMPRESSED_POOL_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "block_key.hpp"
+#include "lz_codec.hpp"
+
+// Secondary in-memory tier for blocks evicted from the hot slots. Blocks are
+// kept LZ-compressed within a byte budget and handed back on a later miss,
+// which costs a decompression instead of a network fetch. A block lives in
+// either the slots or the pool, never both: take() removes it. Oldest
+// entries are dropped first when the budget is exceeded.
+// Not thread safe, except compress(): the owning shard serializes access.
+class CompressedPool {
+public:
+    struct Stats {
+        uint64_t stores;        // blocks kept
+        uint64_t rejects;       // blocks that did not compress well enough
+        uint64_t hits;          // blocks decompressed back out
+        uint64_t raw_bytes;     // input bytes of all stores
+        uint64_t stored_bytes;  // compressed bytes of all stores
+        uint64_t resident_bytes; // compressed bytes held now
+        uint64_t decompress_ns; // time spent decompressing hits
+    };
+
+    // A compressed block detached from the pool by take()
+    struct Blob {
+        std::unique_ptr<uint8_t[]> data;
+        uint32_t size = 0;
+        uint32_t valid_len = 0;
+        uint32_t generation = 0; // of the file, when stored (see BlockCache)
+    };
+
+    explicit CompressedPool(size_t block_size) : block_size_(block_size) {}
+
+    CompressedPool(const CompressedPool&) = delete;
+    CompressedPool& operator=(const CompressedPool&) = delete;
+
+    // Bound the pool to budget_bytes, dropping the oldest entries to fit.
+    // 0 disables it and frees everything. Returns bytes freed.
+    size_t set_budget(size_t budget_bytes);
+    size_t budget() const { return budget_; }
+    bool enabled() const { return budget_ != 0; }
+
+    // Compress len bytes of a block into out. Touches no pool state, so the
+    // owning shard may run it unlocked. Blocks that would not save at least
+    // 1/8 of their size are rejected: out is left without data.
+    static bool compress(uint32_t generation, const uint8_t* data, size_t len, Blob* out);
+    // Keep key's block as compressed by compress(), replacing any older
+    // copy. A rejected blob is only counted. Returns false if not kept.
+    bool insert(const BlockKey& key, Blob blob);
+    // compress() and insert() in one go
+    bool store(const BlockKey& key, uint32_t generation, const uint8_t* data, size_t len);
+    bool contains(const BlockKey& key) const { return entries_.count(key) != 0; }
+    // Detach key's block. False if it is not in the pool.
+    bool take(const BlockKey& key, Blob* out);
+    // Decompress a taken blob into out (block_size bytes). Returns its valid
+    // length, or -1 if the blob is corrupt.
+    int decompress(const Blob& blob, uint8_t* out);
+    bool erase(const BlockKey& key);
+    // Drop key's block if it was stored under another generation. True if dropped.
+    bool erase_stale(const BlockKey& key, uint32_t generation);
+
+    // Drop the oldest entries until at most target_bytes are held. Returns
+    // bytes freed.
+    size_t shrink(size_t target_bytes);
+
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct Entry {
+        Blob blob;
+        std::list<BlockKey>::iterator order;
+    };
+
+    size_t block_size_;
+    size_t budget_ = 0;
+    std::unordered_map<BlockKey, Entry, BlockKeyHash> entries_;
+    std::list<BlockKey> order_; // oldest first
+    Stats stats_ = {0, 0, 0, 0, 0, 0, 0};
+};
+
+#endif // COMPRESSED_POOL_HPP
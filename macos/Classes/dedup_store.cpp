@@ -0,0 +1,84 @@
+#include "dedup_store.hpp"
+#include <cstring>
+
+uint32_t DedupStore::acquire(uint64_t hash, const uint8_t* data, size_t len, uint8_t** out) {
+    if (len == 0 || len > block_size_) return kNil;
+    uint32_t index = stripe_of(hash);
+    Stripe& s = *stripes_[index];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto range = s.by_hash.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        Entry& e = s.entries[it->second];
+        uint8_t* mem = s.arena.slot(it->second);
+        // A fingerprint match is only a candidate; the bytes decide
+        if (e.len != len || !mem || std::memcmp(mem, data, len) != 0) continue;
+        e.refs++;
+        s.refs++;
+        s.logical_bytes += len;
+        *out = mem;
+        return it->second * kStripes + index;
+    }
+
+    if (s.free_ids.empty()) {
+        s.free_ids.push_back(static_cast<uint32_t>(s.entries.size()));
+        s.entries.emplace_back();
+        s.arena.reserve(s.entries.size());
+    }
+    uint32_t id = s.free_ids.back();
+    uint8_t* mem = s.arena.slot(id);
+    if (!mem) return kNil; // could not map memory
+    s.free_ids.pop_back();
+    std::memcpy(mem, data, len);
+    Entry& e = s.entries[id];
+    e.hash = hash;
+    e.len = static_cast<uint32_t>(len);
+    e.refs = 1;
+    s.by_hash.emplace(hash, id);
+    s.refs++;
+    s.logical_bytes += len;
+    s.stored_bytes += len;
+    *out = mem;
+    return id * kStripes + index;
+}
+
+void DedupStore::release(uint32_t id) {
+    Stripe& s = *stripes_[id % kStripes];
+    id /= kStripes;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    Entry& e = s.entries[id];
+    s.refs--;
+    s.logical_bytes -= e.len;
+    if (--e.refs > 0) return;
+
+    auto range = s.by_hash.equal_range(e.hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == id) {
+            s.by_hash.erase(it);
+            break;
+        }
+    }
+    s.stored_bytes -= e.len;
+    s.arena.release(id);
+    s.free_ids.push_back(id);
+}
+
+size_t DedupStore::committed_bytes() {
+    size_t total = 0;
+    for (auto& s : stripes_) {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        total += s->arena.committed_bytes();
+    }
+    return total;
+}
+
+DedupStore::Stats DedupStore::stats() {
+    Stats total = {0, 0, 0, 0};
+    for (auto& s : stripes_) {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        total.refs += s->refs;
+        total.unique += s->by_hash.size();
+        total.logical_bytes += s->logical_bytes;
+        total.stored_bytes += s->stored_bytes;
+    }
+    return total;
+}
@@ -0,0 +1,87 @@
+#ifndef DEDUP_STORE_HPP
+#define DEDUP_STORE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "slab_arena.hpp"
+
+// Content-addressed block payloads shared by BlockCache slots. Blocks with
+// identical contents (the same BIOS in several folders, regional variants,
+// tracks shared by a multi-disc set, zero padding) are kept once and
+// reference counted, so cache memory follows the unique data. Payloads are
+// found by a hash64 fingerprint and compared in full before being shared.
+// A payload is immutable while referenced; writers take a private copy.
+// Striped by hash, so concurrent acquires of different contents do not
+// contend. Thread safe; callers may hold a shard lock, never the other way
+// round.
+class DedupStore {
+public:
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    struct Stats {
+        uint64_t refs;          // slots referencing a shared payload
+        uint64_t unique;        // payloads held
+        uint64_t logical_bytes; // block bytes the references stand for
+        uint64_t stored_bytes;  // bytes of the payloads held
+    };
+
+    explicit DedupStore(size_t block_size) : block_size_(block_size) {
+        for (uint32_t i = 0; i < kStripes; ++i) stripes_.emplace_back(new Stripe(block_size));
+    }
+
+    DedupStore(const DedupStore&) = delete;
+    DedupStore& operator=(const DedupStore&) = delete;
+
+    // Only new references are affected; shared payloads stay until released
+    void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Reference the payload equal to len bytes of data, whose hash64 is
+    // hash, adding it if there is none. Returns its id, with its memory in
+    // *out (valid until released), or kNil if memory cannot be mapped.
+    uint32_t acquire(uint64_t hash, const uint8_t* data, size_t len, uint8_t** out);
+    // Drop a reference; the last one frees the payload's memory
+    void release(uint32_t id);
+
+    size_t committed_bytes();
+    Stats stats();
+
+private:
+    // Payload ids carry their stripe in the low bits
+    static constexpr uint32_t kStripes = 16;
+
+    struct Entry {
+        uint64_t hash = 0;
+        uint32_t len = 0;
+        uint32_t refs = 0; // 0: free id
+    };
+
+    // Payloads whose hash maps here, with their own lock and memory
+    struct Stripe {
+        std::mutex mutex;
+        SlabArena arena;
+        std::vector<Entry> entries; // by index within the stripe
+        std::vector<uint32_t> free_ids;
+        std::unordered_multimap<uint64_t, uint32_t> by_hash;
+        uint64_t refs = 0;
+        uint64_t logical_bytes = 0;
+        uint64_t stored_bytes = 0;
+
+        explicit Stripe(size_t block_size) : arena(block_size) {}
+    };
+
+    // The top bits: the low ones pick by_hash buckets
+    static uint32_t stripe_of(uint64_t hash) { return static_cast<uint32_t>(hash >> 60) % kStripes; }
+
+    size_t block_size_;
+    std::atomic<bool> enabled_{false};
+    std::vector<std::unique_ptr<Stripe>> stripes_;
+};
+
+#endif // DEDUP_STORE_HPP
@@ -0,0 +1,88 @@
+#include "delta_write.hpp"
+#include "block_cache.hpp"
+#include <nfsc/libnfs.h>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__GNUC__)
+#define EXPORT __attribute__((visibility("default"))) __attribute__((used))
+#else
+#define EXPORT
+#endif
+
+static bool pwrite_all(struct nfs_context* nfs, struct nfsfh* fh, const uint8_t* data, size_t len, uint64_t offset) {
+    while (len > 0) {
+        int res = nfs_pwrite(nfs, fh, (void*)data, len, offset);
+        if (res <= 0) return false;
+        data += res;
+        len -= res;
+        offset += res;
+    }
+    return true;
+}
+
+// Change attribute of the file as the server reports it now, 0 if unknown;
+// its size goes to *size
+static uint64_t current_change(struct nfs_context* nfs, struct nfsfh* fh, uint64_t* size) {
+    struct nfs_stat_64 st;
+    if (nfs_fstat64(nfs, fh, &st) != 0) return 0;
+    *size = st.nfs_size;
+    return BlockCache::make_change_attr(st.nfs_size, st.nfs_mtime, st.nfs_mtime_nsec);
+}
+
+int delta_pwrite(struct nfs_context* nfs, struct nfsfh* fh, std::mutex* nfs_mutex, uint64_t file_id,
+                 const uint8_t* data, size_t len, uint64_t offset) {
+    if (len == 0) return 0;
+    BlockCache& cache = BlockCache::instance();
+    std::unique_lock<std::mutex> lock;
+    if (nfs_mutex) lock = std::unique_lock<std::mutex>(*nfs_mutex);
+
+    // Diff only against what the server still holds: if the file changed
+    // elsewhere since it was cached, bytes equal to our stale copy may
+    // differ on the server
+    uint64_t size = 0;
+    uint64_t change = current_change(nfs, fh, &size);
+    if (lock) lock.unlock();
+    bool current = change != 0 && change == cache.file_change(file_id);
+    if (!current && change != 0 && cache.revalidate(file_id, change)) cache.set_file_size(file_id, size);
+
+    std::vector<BlockCache::WriteRange> ranges;
+    bool delta = current && cache.diff_cached(file_id, offset, data, len, kDeltaMinGap, &ranges);
+    if (!delta) ranges.assign(1, {0, len});
+
+    size_t sent = 0;
+    bool ok = true;
+    if (nfs_mutex) lock.lock();
+    for (const BlockCache::WriteRange& range : ranges) {
+        if (!pwrite_all(nfs, fh, data + range.offset, range.len, offset + range.offset)) {
+            ok = false;
+            break;
+        }
+        sent += range.len;
+    }
+    // Record the change attribute our WRITEs produced, so the next delta
+    // write does not take them for a modification made elsewhere
+    if (ok && sent > 0 && !cache.has_dirty(file_id)) {
+        change = current_change(nfs, fh, &size);
+        if (change != 0) cache.set_file_change(file_id, change);
+    }
+    if (lock) lock.unlock();
+
+    if (!ok) {
+        // Part of the write may have landed: the cached copy is unreliable
+        for (uint64_t b = offset / BLOCK_SIZE; b <= (offset + len - 1) / BLOCK_SIZE; ++b) {
+            cache.invalidate_block(file_id, b);
+        }
+        return -1;
+    }
+    cache.write_through(file_id, offset, data, len);
+    cache.record_delta_write(len, sent, !delta);
+    return (int)len;
+}
+
+extern "C" {
+    EXPORT int bridge_nfs_delta_pwrite(struct nfs_context* nfs, struct nfsfh* fh, uint64_t file_id,
+                                       const uint8_t* data, size_t count, uint64_t offset) {
+        if (!nfs || !fh || (!data && count > 0)) return -1;
+        return delta_pwrite(nfs, fh, nullptr, file_id, data, count, offset);
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef DELTA_WRITE_HPP
+#define DELTA_WRITE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+
+struct nfs_context;
+struct nfsfh;
+
+// Unchanged gaps shorter than this are rewritten rather than splitting a
+// WRITE in two; a round trip costs more than sending a few KB.
+constexpr size_t kDeltaMinGap = 16 * 1024;
+
+// pwrite that only sends the ranges differing from the BlockCache copy of
+// file_id (e.g. a savestate rewritten whole), or everything if that copy
+// is missing or stale, or the file's change attribute says it was modified
+// elsewhere. Keeps the cached copy up to date either way.
+// nfs_mutex, if given, is held around the WRITEs. Returns len, or -1 on
+// error (the written range is then dropped from the cache).
+int delta_pwrite(struct nfs_context* nfs, struct nfsfh* fh, std::mutex* nfs_mutex, uint64_t file_id,
+                 const uint8_t* data, size_t len, uint64_t offset);
+
+extern "C" {
+    // delta_pwrite for callers that serialize access to nfs themselves (Dart)
+    int bridge_nfs_delta_pwrite(struct nfs_context* nfs, struct nfsfh* fh, uint64_t file_id,
+                                const uint8_t* data, size_t count, uint64_t offset);
+}
+
+#endif // DELTA_WRITE_HPP
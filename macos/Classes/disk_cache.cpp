@@ -0,0 +1,276 @@
+#include "disk_cache.hpp"
+#include "hash64.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint64_t kSegmentMagic = 0x3247534C5346464EULL; // "NFFSLSG2"
+constexpr uint32_t kSegmentVersion = 1;
+constexpr uint32_t kEntriesPerSegment = 256; // at most
+constexpr size_t kPageSize = 4096;
+
+struct SegmentHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t entries;
+};
+
+} // namespace
+
+// One per entry, in a table after the segment header. seq 0 means empty.
+struct EntryHeader {
+    uint64_t file_id;
+    uint64_t change;
+    uint64_t block_id;
+    uint64_t seq;
+    uint64_t payload_sum;
+    uint32_t valid_len;
+    uint32_t reserved;
+    uint64_t pad;
+    uint64_t header_sum; // hash64 of the fields above, written last
+};
+static_assert(sizeof(EntryHeader) == 64, "EntryHeader layout is on disk");
+
+static uint64_t header_checksum(const EntryHeader* h) {
+    return hash64(h, offsetof(EntryHeader, header_sum));
+}
+
+std::unique_ptr<DiskCache> DiskCache::open(const std::string& dir, size_t capacity_mb, size_t block_size) {
+    if (dir.empty() || block_size == 0) return nullptr;
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cout << "[DiskCache] Cannot create " << dir << ": " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    // Whole segments of kEntriesPerSegment blocks, or two smaller ones when
+    // the capacity is below that, so the ring never outgrows capacity_mb
+    size_t capacity_blocks = capacity_mb * 1024 * 1024 / block_size;
+    if (capacity_blocks < 2) {
+        std::cout << "[DiskCache] " << capacity_mb << " MB holds fewer than two blocks" << std::endl;
+        return nullptr;
+    }
+    std::unique_ptr<DiskCache> cache(new DiskCache(block_size));
+    size_t entries = std::min<size_t>(kEntriesPerSegment, capacity_blocks / 2);
+    size_t count = capacity_blocks / entries;
+    cache->entries_per_segment_ = static_cast<uint32_t>(entries);
+    size_t table_bytes = (entries * sizeof(EntryHeader) + kPageSize - 1) / kPageSize * kPageSize;
+    cache->payload_offset_ = kPageSize + table_bytes;
+    cache->segment_bytes_ = cache->payload_offset_ + entries * block_size;
+    size_t segment_payload = entries * block_size;
+
+    char name[40];
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(name, sizeof(name), "/l2-seg-%03zu.bin", i);
+        Segment seg;
+        if (!cache->map_segment(dir + name, &seg)) return nullptr;
+        cache->segments_.push_back(seg);
+    }
+    // Drop segments left over from a larger configuration
+    for (size_t i = count;; ++i) {
+        snprintf(name, sizeof(name), "/l2-seg-%03zu.bin", i);
+        if (unlink((dir + name).c_str()) != 0) break;
+    }
+
+    for (uint32_t s = 0; s < cache->segments_.size(); ++s) cache->load_segment(s);
+    std::cout << "[DiskCache] Opened " << dir << ": " << count << " segments ("
+              << count * segment_payload / (1024 * 1024) << " MB), "
+              << cache->index_.size() << " blocks" << std::endl;
+    return cache;
+}
+
+DiskCache::~DiskCache() {
+    for (Segment& seg : segments_) {
+        if (seg.base) munmap(seg.base, segment_bytes_);
+        if (seg.fd >= 0) close(seg.fd);
+    }
+}
+
+bool DiskCache::map_segment(const std::string& path, Segment* seg) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        std::cout << "[DiskCache] Cannot open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    bool fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != segment_bytes_;
+    if (fresh && ftruncate(fd, (off_t)segment_bytes_) != 0) {
+        std::cout << "[DiskCache] Cannot size " << path << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, segment_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    seg->fd = fd;
+    seg->base = static_cast<uint8_t*>(base);
+
+    SegmentHeader* sh = reinterpret_cast<SegmentHeader*>(seg->base);
+    if (fresh || sh->magic != kSegmentMagic || sh->version != kSegmentVersion ||
+        sh->block_size != block_size_ || sh->entries != entries_per_segment_) {
+        memset(seg->base, 0, payload_offset_);
+        sh->magic = kSegmentMagic;
+        sh->version = kSegmentVersion;
+        sh->block_size = static_cast<uint32_t>(block_size_);
+        sh->entries = entries_per_segment_;
+    }
+    return true;
+}
+
+EntryHeader* DiskCache::header(uint32_t segment, uint32_t entry) {
+    return reinterpret_cast<EntryHeader*>(segments_[segment].base + kPageSize) + entry;
+}
+
+uint8_t* DiskCache::payload(uint32_t segment, uint32_t entry) {
+    return segments_[segment].base + payload_offset_ + (size_t)entry * block_size_;
+}
+
+void DiskCache::load_segment(uint32_t segment) {
+    for (uint32_t e = 0; e < entries_per_segment_; ++e) {
+        EntryHeader* h = header(segment, e);
+        if (h->seq == 0) continue;
+        if (h->header_sum != header_checksum(h) || h->valid_len > block_size_) {
+            // Torn header: never published
+            memset(h, 0, sizeof(*h));
+            continue;
+        }
+        DiskKey key = {h->file_id, h->change, h->block_id};
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            if (header(it->second.segment, it->second.entry)->seq > h->seq) continue;
+        }
+        index_[key] = {segment, e};
+        if (h->seq >= next_seq_) {
+            // Resume writing right after the newest entry
+            next_seq_ = h->seq + 1;
+            cursor_segment_ = segment;
+            cursor_entry_ = e + 1;
+        }
+    }
+}
+
+void DiskCache::evict_entry(uint32_t segment, uint32_t entry) {
+    EntryHeader* h = header(segment, entry);
+    if (h->seq != 0) {
+        DiskKey key = {h->file_id, h->change, h->block_id};
+        auto it = index_.find(key);
+        if (it != index_.end() && it->second.segment == segment && it->second.entry == entry) {
+            index_.erase(it);
+        }
+    }
+    h->seq = 0;
+    h->header_sum = 0;
+}
+
+bool DiskCache::contains(const DiskKey& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.count(key) != 0;
+}
+
+int DiskCache::read(const DiskKey& key, uint8_t* out) {
+    Location loc;
+    uint64_t seq, sum;
+    uint32_t valid_len;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return -1;
+        }
+        loc = it->second;
+        EntryHeader* h = header(loc.segment, loc.entry);
+        seq = h->seq;
+        sum = h->payload_sum;
+        valid_len = h->valid_len;
+    }
+
+    // Copy without the lock; the checksum and seq re-check below catch an
+    // overwrite that raced with the copy.
+    memcpy(out, payload(loc.segment, loc.entry), valid_len);
+    bool intact = hash64(out, valid_len, seq) == sum;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    EntryHeader* h = header(loc.segment, loc.entry);
+    if (h->seq != seq) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+    }
+    if (!intact) {
+        // Payload pages never reached the disk before a crash
+        corrupt_.fetch_add(1, std::memory_order_relaxed);
+        evict_entry(loc.segment, loc.entry);
+        return -1;
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<int>(valid_len);
+}
+
+void DiskCache::store(const DiskKey& key, const uint8_t* data, size_t len) {
+    if (len > block_size_) len = block_size_;
+    uint32_t segment, entry;
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index_.count(key)) return;
+        if (cursor_entry_ >= entries_per_segment_) {
+            cursor_segment_ = (cursor_segment_ + 1) % segments_.size();
+            cursor_entry_ = 0;
+        }
+        segment = cursor_segment_;
+        entry = cursor_entry_++;
+        seq = next_seq_++;
+        evict_entry(segment, entry);
+    }
+
+    // The entry is unindexed with seq 0 until published, so nobody reads it
+    memcpy(payload(segment, entry), data, len);
+    uint64_t sum = hash64(data, len, seq);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    EntryHeader* h = header(segment, entry);
+    if (h->seq != 0 || index_.count(key)) return; // lapped by the ring, or raced
+    h->file_id = key.file_id;
+    h->change = key.change;
+    h->block_id = key.block_id;
+    h->payload_sum = sum;
+    h->valid_len = static_cast<uint32_t>(len);
+    h->reserved = 0;
+    h->pad = 0;
+    h->seq = seq;
+    h->header_sum = header_checksum(h);
+    index_[key] = {segment, entry};
+    writes_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DiskCache::erase(const DiskKey& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    evict_entry(it->second.segment, it->second.entry);
+}
+
+size_t DiskCache::entry_count() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.size();
+}
+
+DiskCache::Stats DiskCache::stats() const {
+    Stats out;
+    out.hits = hits_.load(std::memory_order_relaxed);
+    out.misses = misses_.load(std::memory_order_relaxed);
+    out.writes = writes_.load(std::memory_order_relaxed);
+    out.corrupt = corrupt_.load(std::memory_order_relaxed);
+    return out;
+}
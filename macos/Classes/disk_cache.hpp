@@ -0,0 +1,106 @@
+#ifndef DISK_CACHE_HPP
+#define DISK_CACHE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Identity of a block on disk. change is derived from the file's attributes
+// (size, mtime), so a file modified on the server never hits stale entries.
+struct DiskKey {
+    uint64_t file_id;
+    uint64_t change;
+    uint64_t block_id;
+
+    bool operator==(const DiskKey& other) const {
+        return file_id == other.file_id && change == other.change && block_id == other.block_id;
+    }
+};
+
+struct DiskKeyHash {
+    size_t operator()(const DiskKey& key) const {
+        uint64_t h = key.file_id * 0x9E3779B97F4A7C15ULL ^ key.change;
+        h ^= key.block_id + 0x7F4A7C159E3779B9ULL + (h << 6) + (h >> 2);
+        return static_cast<size_t>(h);
+    }
+};
+
+// Persistent second tier under BlockCache: a ring of memory-mapped segment
+// files in an app cache directory. Blocks are appended at a cursor that
+// overwrites the oldest entry once the ring is full (FIFO eviction, which
+// also keeps writes sequential on flash). Every entry carries checksums of
+// its header and payload, so entries torn by a crash or overwritten during a
+// read come back as misses. The index lives in RAM and is rebuilt from the
+// entry headers on open.
+class DiskCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t writes;
+        uint64_t corrupt; // entries dropped on a checksum mismatch
+    };
+
+    // Open (or create) the cache in dir, sized to capacity_mb rounded down to
+    // whole segments; never larger. Returns nullptr if the directory or
+    // segments are unusable, or capacity_mb holds fewer than two blocks.
+    static std::unique_ptr<DiskCache> open(const std::string& dir, size_t capacity_mb, size_t block_size);
+    ~DiskCache();
+
+    DiskCache(const DiskCache&) = delete;
+    DiskCache& operator=(const DiskCache&) = delete;
+
+    bool contains(const DiskKey& key);
+    // Copy the block into out (block_size bytes). Returns its valid length,
+    // or -1 on a miss or checksum mismatch.
+    int read(const DiskKey& key, uint8_t* out);
+    void store(const DiskKey& key, const uint8_t* data, size_t len);
+    void erase(const DiskKey& key);
+
+    size_t entry_count();
+    Stats stats() const;
+
+private:
+    struct Segment {
+        int fd = -1;
+        uint8_t* base = nullptr;
+    };
+
+    struct Location {
+        uint32_t segment;
+        uint32_t entry;
+    };
+
+    explicit DiskCache(size_t block_size) : block_size_(block_size) {}
+
+    bool map_segment(const std::string& path, Segment* seg);
+    void load_segment(uint32_t segment);
+    // Unindex and clear an entry before it is overwritten. Caller holds mutex_.
+    void evict_entry(uint32_t segment, uint32_t entry);
+    struct EntryHeader* header(uint32_t segment, uint32_t entry);
+    uint8_t* payload(uint32_t segment, uint32_t entry);
+
+    size_t block_size_;
+    uint32_t entries_per_segment_ = 0;
+    size_t segment_bytes_ = 0;
+    size_t payload_offset_ = 0;
+    std::vector<Segment> segments_;
+
+    std::mutex mutex_;
+    std::unordered_map<DiskKey, Location, DiskKeyHash> index_;
+    uint32_t cursor_segment_ = 0; // next entry to write
+    uint32_t cursor_entry_ = 0;
+    uint64_t next_seq_ = 1;       // write order across the ring; 0 marks empty
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> writes_{0};
+    std::atomic<uint64_t> corrupt_{0};
+};
+
+#endif // DISK_CACHE_HPP
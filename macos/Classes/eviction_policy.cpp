@@ -0,0 +1,174 @@
+#include "eviction_policy.hpp"
+#include <algorithm>
+
+std::unique_ptr<EvictionPolicy> EvictionPolicy::create(EvictionPolicyType type, size_t slots) {
+    switch (type) {
+        case kEvictS3Fifo: return std::unique_ptr<EvictionPolicy>(new S3FifoPolicy(slots));
+        case kEvictLru:
+        default:           return std::unique_ptr<EvictionPolicy>(new LruPolicy(slots));
+    }
+}
+
+const char* EvictionPolicy::name(EvictionPolicyType type) {
+    switch (type) {
+        case kEvictS3Fifo: return "S3-FIFO";
+        case kEvictLru:
+        default:           return "LRU";
+    }
+}
+
+// --- SlotList ---
+
+void SlotList::push_front(uint32_t slot) {
+    std::vector<uint32_t>& prev = *prev_;
+    std::vector<uint32_t>& next = *next_;
+    prev[slot] = kNil;
+    next[slot] = head_;
+    if (head_ != kNil) prev[head_] = slot;
+    head_ = slot;
+    if (tail_ == kNil) tail_ = slot;
+    size_++;
+}
+
+void SlotList::unlink(uint32_t slot) {
+    std::vector<uint32_t>& prev = *prev_;
+    std::vector<uint32_t>& next = *next_;
+    if (prev[slot] != kNil) next[prev[slot]] = next[slot]; else head_ = next[slot];
+    if (next[slot] != kNil) prev[next[slot]] = prev[slot]; else tail_ = prev[slot];
+    prev[slot] = next[slot] = kNil;
+    size_--;
+}
+
+// --- LRU ---
+
+LruPolicy::LruPolicy(size_t slots)
+    : prev_(slots, kNil), next_(slots, kNil), list_(&prev_, &next_) {}
+
+void LruPolicy::resize(size_t slots, size_t) {
+    if (slots <= prev_.size()) return;
+    prev_.resize(slots, kNil);
+    next_.resize(slots, kNil);
+}
+
+void LruPolicy::on_insert(uint32_t slot, uint64_t) {
+    on_reinsert(slot);
+}
+
+void LruPolicy::on_reinsert(uint32_t slot) {
+    if (list_.contains(slot)) list_.unlink(slot);
+    list_.push_front(slot);
+}
+
+void LruPolicy::on_access(uint32_t slot) {
+    if (!list_.contains(slot)) return;
+    list_.unlink(slot);
+    list_.push_front(slot);
+}
+
+void LruPolicy::on_remove(uint32_t slot) {
+    if (list_.contains(slot)) list_.unlink(slot);
+}
+
+uint32_t LruPolicy::pick_victim() {
+    uint32_t victim = list_.tail();
+    if (victim != kNil) list_.unlink(victim);
+    return victim;
+}
+
+// --- S3-FIFO ---
+
+S3FifoPolicy::S3FifoPolicy(size_t slots)
+    : prev_(slots, kNil), next_(slots, kNil), freq_(slots, 0), in_main_(slots, 0),
+      key_hash_(slots, 0), small_(&prev_, &next_), main_(&prev_, &next_),
+      small_target_(std::max<size_t>(1, slots / 10)), ghost_capacity_(slots) {}
+
+void S3FifoPolicy::resize(size_t slots, size_t capacity) {
+    if (slots > prev_.size()) {
+        prev_.resize(slots, kNil);
+        next_.resize(slots, kNil);
+        freq_.resize(slots, 0);
+        in_main_.resize(slots, 0);
+        key_hash_.resize(slots, 0);
+    }
+    small_target_ = std::max<size_t>(1, capacity / 10);
+    ghost_capacity_ = capacity;
+    trim_ghosts();
+}
+
+void S3FifoPolicy::trim_ghosts() {
+    while (ghost_fifo_.size() > ghost_capacity_) {
+        auto it = ghost_count_.find(ghost_fifo_.front());
+        ghost_fifo_.pop_front();
+        if (it != ghost_count_.end() && --it->second == 0) ghost_count_.erase(it);
+    }
+}
+
+void S3FifoPolicy::remember_ghost(uint64_t key_hash) {
+    ghost_fifo_.push_back(key_hash);
+    ghost_count_[key_hash]++;
+    trim_ghosts();
+}
+
+void S3FifoPolicy::on_insert(uint32_t slot, uint64_t key_hash) {
+    on_remove(slot);
+    key_hash_[slot] = key_hash;
+    freq_[slot] = 0;
+    auto ghost = ghost_count_.find(key_hash);
+    if (ghost != ghost_count_.end()) {
+        // Evicted from probation recently and back already: it is not a scan
+        in_main_[slot] = 1;
+        main_.push_front(slot);
+    } else {
+        in_main_[slot] = 0;
+        small_.push_front(slot);
+    }
+}
+
+void S3FifoPolicy::on_reinsert(uint32_t slot) {
+    // Was resident and in use (pinned): treat it as proven and keep it in main
+    on_remove(slot);
+    in_main_[slot] = 1;
+    freq_[slot] = std::max<uint8_t>(freq_[slot], 1);
+    main_.push_front(slot);
+}
+
+void S3FifoPolicy::on_access(uint32_t slot) {
+    if (freq_[slot] < kMaxFreq) freq_[slot]++;
+}
+
+void S3FifoPolicy::on_remove(uint32_t slot) {
+    if (in_main_[slot]) {
+        if (main_.contains(slot)) main_.unlink(slot);
+    } else {
+        if (small_.contains(slot)) small_.unlink(slot);
+    }
+}
+
+uint32_t S3FifoPolicy::pick_victim() {
+    // Each pass either evicts or moves a block with remaining frequency
+    // (decrementing it), so this terminates; amortized O(1) per eviction.
+    while (small_.size() > 0 || main_.size() > 0) {
+        if (small_.size() >= small_target_ || main_.size() == 0) {
+            uint32_t slot = small_.tail();
+            small_.unlink(slot);
+            if (freq_[slot] > 1) {
+                freq_[slot] = 0;
+                in_main_[slot] = 1;
+                main_.push_front(slot);
+                continue;
+            }
+            remember_ghost(key_hash_[slot]);
+            return slot;
+        }
+
+        uint32_t slot = main_.tail();
+        main_.unlink(slot);
+        if (freq_[slot] > 0) {
+            freq_[slot]--;
+            main_.push_front(slot);
+            continue;
+        }
+        return slot;
+    }
+    return kNil;
+}
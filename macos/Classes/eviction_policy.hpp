@@ -0,0 +1,122 @@
+#ifndef EVICTION_POLICY_HPP
+#define EVICTION_POLICY_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+
+// Replacement policies for BlockCache shards. A policy only orders slot
+// indices; the shard owns keys, payloads and the key -> slot map. Slots are
+// tracked from on_insert until they are evicted or on_remove'd. Pinned and
+// loading slots are never tracked, so pick_victim can always evict.
+enum EvictionPolicyType {
+    kEvictLru = 0,    // plain LRU
+    kEvictS3Fifo = 1, // S3-FIFO: small probationary FIFO + main FIFO + ghost keys
+};
+
+class EvictionPolicy {
+public:
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    static std::unique_ptr<EvictionPolicy> create(EvictionPolicyType type, size_t slots);
+    static const char* name(EvictionPolicyType type);
+
+    virtual ~EvictionPolicy() = default;
+
+    // The shard's slot indices now span [0, slots) and at most capacity of
+    // them hold blocks. Slot indices never shrink.
+    virtual void resize(size_t slots, size_t capacity) = 0;
+
+    // A newly filled block. key_hash identifies the block across evictions
+    // (used by history-based policies).
+    virtual void on_insert(uint32_t slot, uint64_t key_hash) = 0;
+    // A resident block that was off the policy (pinned) becomes evictable again
+    virtual void on_reinsert(uint32_t slot) = 0;
+    virtual void on_access(uint32_t slot) = 0;
+    // Stop tracking slot (pinned, invalidated). No-op if untracked.
+    virtual void on_remove(uint32_t slot) = 0;
+    // Untrack and return the slot to evict, or kNil if nothing is tracked
+    virtual uint32_t pick_victim() = 0;
+};
+
+// Intrusive doubly linked list over slot indices. Head is the newest entry.
+class SlotList {
+public:
+    static constexpr uint32_t kNil = EvictionPolicy::kNil;
+
+    explicit SlotList(std::vector<uint32_t>* prev, std::vector<uint32_t>* next)
+        : prev_(prev), next_(next) {}
+
+    bool contains(uint32_t slot) const { return (*prev_)[slot] != kNil || head_ == slot; }
+    uint32_t tail() const { return tail_; }
+    size_t size() const { return size_; }
+
+    void push_front(uint32_t slot);
+    void unlink(uint32_t slot);
+
+private:
+    std::vector<uint32_t>* prev_;
+    std::vector<uint32_t>* next_;
+    uint32_t head_ = kNil;
+    uint32_t tail_ = kNil;
+    size_t size_ = 0;
+};
+
+class LruPolicy : public EvictionPolicy {
+public:
+    explicit LruPolicy(size_t slots);
+
+    void resize(size_t slots, size_t capacity) override;
+    void on_insert(uint32_t slot, uint64_t key_hash) override;
+    void on_reinsert(uint32_t slot) override;
+    void on_access(uint32_t slot) override;
+    void on_remove(uint32_t slot) override;
+    uint32_t pick_victim() override;
+
+private:
+    std::vector<uint32_t> prev_;
+    std::vector<uint32_t> next_;
+    SlotList list_;
+};
+
+// S3-FIFO (Yang et al., SOSP'23). New blocks enter a small FIFO sized at 10%
+// of capacity; only blocks re-referenced while there are promoted to the
+// main FIFO, so a one-pass scan washes through the small queue without
+// displacing the working set. Main-queue blocks with remaining frequency
+// get reinserted instead of evicted. A ghost FIFO of recently evicted keys
+// sends returning blocks straight to main.
+class S3FifoPolicy : public EvictionPolicy {
+public:
+    explicit S3FifoPolicy(size_t slots);
+
+    void resize(size_t slots, size_t capacity) override;
+    void on_insert(uint32_t slot, uint64_t key_hash) override;
+    void on_reinsert(uint32_t slot) override;
+    void on_access(uint32_t slot) override;
+    void on_remove(uint32_t slot) override;
+    uint32_t pick_victim() override;
+
+private:
+    static constexpr uint8_t kMaxFreq = 3;
+
+    void remember_ghost(uint64_t key_hash);
+    void trim_ghosts();
+
+    std::vector<uint32_t> prev_;
+    std::vector<uint32_t> next_;
+    std::vector<uint8_t> freq_;
+    std::vector<uint8_t> in_main_;
+    std::vector<uint64_t> key_hash_;
+    SlotList small_;
+    SlotList main_;
+    size_t small_target_;
+
+    std::deque<uint64_t> ghost_fifo_;
+    std::unordered_map<uint64_t, uint32_t> ghost_count_; // key_hash -> entries in ghost_fifo_
+    size_t ghost_capacity_;
+};
+
+#endif // EVICTION_POLICY_HPP
@@ -1,6 +1,9 @@
 #include "libretro_defines.h"
+#include "access_pattern.hpp"
 #include "block_cache.hpp"
+#include "delta_write.hpp"
 #include "nfs_pool.hpp"
+#include "prefetch_engine.hpp"
 #include <nfsc/libnfs.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,9 +11,12 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <fcntl.h>
 #include <unistd.h>
 #include <mutex>
+#include <thread>
+#include <atomic>
 #include <sys/stat.h>
 #include <stdarg.h>
 
@@ -18,6 +24,11 @@
 typedef void (*PrefetchCallback)(uint64_t block_id);
 static PrefetchCallback g_prefetch_callback = nullptr;
 
+// Per-file prefetch callbacks, keyed by BlockCache file id. Files without a
+// registration fall back to g_prefetch_callback.
+static std::mutex g_prefetch_mutex;
+static std::unordered_map<uint64_t, PrefetchCallback> g_file_prefetch_callbacks;
+
 typedef void (*DartLogCallback)(int level, const char* message);
 static DartLogCallback g_dart_log_callback = nullptr;
 
@@ -43,6 +54,15 @@ extern "C" {
         g_prefetch_callback = cb;
     }
 
+    EXPORT void nfs_register_prefetch_callback(uint64_t file_id, PrefetchCallback cb) {
+        std::lock_guard<std::mutex> lock(g_prefetch_mutex);
+        if (cb) {
+            g_file_prefetch_callbacks[file_id] = cb;
+        } else {
+            g_file_prefetch_callbacks.erase(file_id);
+        }
+    }
+
     EXPORT retro_log_printf_t get_log_callback_bridge() {
         return libretro_log_bridge;
     }
@@ -75,14 +95,195 @@ static void libretro_log_bridge(enum retro_log_level level, const char *fmt, ...
 }
 
 
+// Upper bound on waiting for a block another reader is already fetching.
+// A READ already on the wire beats issuing a second one for the same data.
+static const uint32_t kInFlightWaitUs = 200 * 1000;
+static const uint32_t kMinFetchWaitUs = 1000;
+
+// How long fetching a block takes, for one handle: smoothed mean and mean
+// deviation of its samples, the way TCP estimates its RTT (RFC 6298). A read
+// waits the mean plus four deviations for a block in flight before fetching
+// it itself. Per handle, so a slow file does not stretch a fast one's waits.
+struct FetchLatency {
+    uint32_t mean_us = 0; // 0: no sample yet
+    uint32_t dev_us = 0;
+
+    void sample(uint64_t us) {
+        uint32_t v = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(us, 1), 10 * 1000 * 1000);
+        if (mean_us == 0) {
+            mean_us = v;
+            dev_us = v / 2;
+            return;
+        }
+        uint32_t err = v > mean_us ? v - mean_us : mean_us - v;
+        dev_us = dev_us - dev_us / 4 + err / 4;
+        mean_us = mean_us - mean_us / 8 + v / 8;
+    }
+
+    uint32_t wait_us() const {
+        if (mean_us == 0) return kInFlightWaitUs;
+        uint64_t us = (uint64_t)mean_us + 4 * (uint64_t)dev_us;
+        return (uint32_t)std::max<uint64_t>(kMinFetchWaitUs, std::min<uint64_t>(us, kInFlightWaitUs));
+    }
+};
+
 struct RetroNfsFile {
     struct nfs_context *nfs;
     struct nfsfh *fh;
     std::mutex* context_mutex; 
+    uint64_t file_id; // BlockCache identity, from fsid/fileid
     uint64_t offset;
     uint64_t size;
+    bool writable;
+    bool written; // written through this handle since the last flush
+    size_t read_extent; // synchronous misses are rounded out to this; 0: exact
+    AccessPattern pattern; // streams of this handle's reads, for readahead
+    FetchLatency fetch_latency;
 };
 
+// --- Write-back ---
+// Off (default): every retro_vfs_write reaches the server before it returns.
+// On: writes land in cached blocks, which are marked dirty and written back
+// later in coalesced WRITEs. See nfs_vfs_set_write_back for the durability
+// contract.
+static std::atomic<bool> g_write_back{false};
+static std::atomic<uint32_t> g_flush_interval_ms{2000};
+static std::atomic<size_t> g_max_dirty_bytes{8 * 1024 * 1024};
+static const size_t kMaxFlushWrite = 1024 * 1024; // per coalesced WRITE
+
+// Writable handles by file id, so the timer and memory pressure can flush a
+// file through any of its connections. Also serializes flushes: a snapshot
+// of a block must never reach the server after a newer one.
+static std::mutex g_write_back_mutex;
+static std::unordered_map<uint64_t, std::vector<struct RetroNfsFile*>> g_writable_files;
+static std::once_flag g_flusher_once;
+
+// Write-through writes send only the ranges that differ from the cached
+// copy (see delta_write.hpp). Off by default.
+static std::atomic<bool> g_delta_writes{false};
+
+// Cache partition charged for the blocks of files opened from now on
+static std::atomic<int> g_cache_partition{0};
+
+// Fetch extent in KB for files opened from now on without one of their own
+// (BlockCache::set_file_extent); -1 uses the server's readmax, 0 (default)
+// reads exactly what was asked.
+static std::atomic<int> g_read_extent_kb{0};
+
+// File ids of handles whose fstat failed: an fsid no server reports, and
+// a sequence number
+static const uint64_t kAnonFsid = UINT64_MAX;
+static std::atomic<uint64_t> g_anon_file_seq{0};
+
+static PrefetchCallback prefetch_callback_for(const RetroNfsFile* file) {
+    std::lock_guard<std::mutex> lock(g_prefetch_mutex);
+    auto it = g_file_prefetch_callbacks.find(file->file_id);
+    return it != g_file_prefetch_callbacks.end() ? it->second : g_prefetch_callback;
+}
+
+// Where a read sends its readahead: the native PrefetchEngine while it
+// runs, else the prefetch callback registered for the file
+struct Prefetcher {
+    uint64_t file_id;
+    PrefetchCallback callback;
+    bool native;
+
+    explicit operator bool() const { return native || callback != nullptr; }
+    void operator()(uint64_t block_id) const {
+        if (native) {
+            PrefetchEngine::instance().enqueue(file_id, block_id);
+        } else {
+            callback(block_id);
+        }
+    }
+};
+
+static Prefetcher prefetcher_for(const RetroNfsFile* file) {
+    if (PrefetchEngine::instance().running()) return {file->file_id, nullptr, true};
+    return {file->file_id, prefetch_callback_for(file), false};
+}
+
+static bool pwrite_fully(RetroNfsFile* file, const uint8_t* data, size_t len, uint64_t offset) {
+    std::lock_guard<std::mutex> lock(*file->context_mutex);
+    while (len > 0) {
+        int res = nfs_pwrite(file->nfs, file->fh, (void*)data, len, offset);
+        if (res <= 0) {
+            printf("[LibretroVFS] Write-back of %zu bytes at %llu failed: %s\n", len,
+                   (unsigned long long)offset, nfs_get_error(file->nfs));
+            fflush(stdout);
+            return false;
+        }
+        data += res;
+        len -= res;
+        offset += res;
+    }
+    return true;
+}
+
+// Write back the file's dirty blocks through file's connection. A failed
+// extent stays dirty for the next flush. Caller holds g_write_back_mutex.
+static int flush_dirty_locked(RetroNfsFile* file) {
+    BlockCache& cache = BlockCache::instance();
+    int result = 0;
+    for (const BlockCache::DirtyExtent& extent : cache.collect_dirty(file->file_id, kMaxFlushWrite)) {
+        if (pwrite_fully(file, extent.data.data(), extent.data.size(), extent.offset)) {
+            cache.mark_clean(file->file_id, extent);
+        } else {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+static void flush_file_id(uint64_t file_id) {
+    std::lock_guard<std::mutex> lock(g_write_back_mutex);
+    auto it = g_writable_files.find(file_id);
+    if (it != g_writable_files.end() && !it->second.empty()) flush_dirty_locked(it->second.front());
+}
+
+// BlockCache flush handler, called by trim under memory pressure
+static void flush_all_dirty() {
+    std::lock_guard<std::mutex> lock(g_write_back_mutex);
+    for (auto& entry : g_writable_files) {
+        if (!entry.second.empty()) flush_dirty_locked(entry.second.front());
+    }
+}
+
+// Writes back files whose oldest dirty write is older than the interval
+static void flusher_loop() {
+    for (;;) {
+        uint32_t interval_ms = g_flush_interval_ms.load();
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::max<uint32_t>(interval_ms / 2, 10)));
+        for (uint64_t file_id : BlockCache::instance().dirty_files(std::chrono::milliseconds(interval_ms))) {
+            flush_file_id(file_id);
+        }
+    }
+}
+
+// Bring block b in from the server so a partial write can be applied to it
+static bool fill_block(RetroNfsFile* file, uint64_t b);
+
+// Apply a write to cached blocks as dirty data. False if some block could
+// not take it; the blocks before it are dirty already, so the caller must
+// flush before writing through.
+static bool absorb_write(RetroNfsFile* file, const uint8_t* data, uint64_t len) {
+    BlockCache& cache = BlockCache::instance();
+    uint64_t pos = file->offset;
+    uint64_t done = 0;
+    while (done < len) {
+        uint64_t b = pos / BLOCK_SIZE;
+        size_t off = pos % BLOCK_SIZE;
+        size_t n = (size_t)std::min<uint64_t>(BLOCK_SIZE - off, len - done);
+        if (!cache.write_block(file->file_id, b, off, data + done, n, true) &&
+            !(fill_block(file, b) && cache.write_block(file->file_id, b, off, data + done, n, true))) {
+            return false;
+        }
+        done += n;
+        pos += n;
+    }
+    return true;
+}
+
 // --- VFS Implementation ---
 
 static const char *retro_vfs_get_path(struct retro_vfs_file_handle *stream) {
@@ -175,44 +376,118 @@ static struct retro_vfs_file_handle *retro_vfs_open(const char *path, unsigned m
     file->fh = fh;
     file->context_mutex = handle.mutex;
     file->offset = 0;
+    file->writable = (mode & RETRO_VFS_FILE_ACCESS_WRITE) != 0;
+    file->written = false;
     
     struct nfs_stat_64 st;
     {
         std::lock_guard<std::mutex> lock(*file->context_mutex);
         if (nfs_fstat64(file->nfs, fh, &st) == 0) {
             file->size = st.nfs_size;
+            file->file_id = BlockCache::make_file_id(st.nfs_dev, st.nfs_ino);
+            // Unflushed writes from another handle are newer than the server's view
+            if (!BlockCache::instance().has_dirty(file->file_id)) {
+                // Modified elsewhere since we cached it: drop the old contents
+                if (BlockCache::instance().revalidate(file->file_id,
+                        BlockCache::make_change_attr(st.nfs_size, st.nfs_mtime, st.nfs_mtime_nsec))) {
+                    printf("[LibretroVFS] %s changed on the server, cache invalidated\n", filename.c_str());
+                }
+                BlockCache::instance().set_file_size(file->file_id, file->size);
+            }
         } else {
             file->size = 0;
+            // No fileid available: give the handle an id of its own, never
+            // reused (a freed handle's address is), so it cannot alias the
+            // blocks of another file, open or closed
+            file->file_id = BlockCache::make_file_id(kAnonFsid, ++g_anon_file_seq);
+        }
+    }
+    BlockCache::instance().set_file_partition(file->file_id, g_cache_partition.load(std::memory_order_relaxed));
+    PrefetchEngine::instance().add_file(file->file_id, server, export_path, filename);
+
+    size_t extent = BlockCache::instance().file_extent(file->file_id);
+    if (extent == 0) {
+        int kb = g_read_extent_kb.load(std::memory_order_relaxed);
+        if (kb < 0) {
+            std::lock_guard<std::mutex> lock(*file->context_mutex);
+            extent = nfs_get_readmax(file->nfs);
+        } else {
+            extent = (size_t)kb * 1024;
+        }
+    }
+    file->read_extent = std::min(extent, BlockCache::kMaxExtent) / SUB_BLOCK_SIZE * SUB_BLOCK_SIZE;
+
+    if (file->writable) {
+        std::lock_guard<std::mutex> lock(g_write_back_mutex);
+        auto& handles = g_writable_files[file->file_id];
+        handles.push_back(file);
+        // The only writer, yet dirty blocks: left by a close whose
+        // write-back failed. Ours to write back and COMMIT now.
+        if (handles.size() == 1 && BlockCache::instance().has_dirty(file->file_id)) {
+            file->written = true;
+            if (flush_dirty_locked(file) == 0) printf("[LibretroVFS] Wrote back blocks kept from an earlier close\n");
         }
     }
 
     printf("[LibretroVFS] ========================================\n");
     printf("[LibretroVFS] Successfully opened: %s\n", filename.c_str());
     printf("[LibretroVFS]   Size: %llu bytes\n", file->size);
+    printf("[LibretroVFS]   File ID: %016llx\n", (unsigned long long)file->file_id);
     printf("[LibretroVFS]   Handle: %p\n", (void*)file);
     printf("[LibretroVFS] ========================================\n");
     fflush(stdout);
     return (struct retro_vfs_file_handle*)file;
 }
 
+static int retro_vfs_flush(struct retro_vfs_file_handle *stream);
+
 static int retro_vfs_close(struct retro_vfs_file_handle *stream) {
     if (!stream) return -1;
     RetroNfsFile* file = (RetroNfsFile*)stream;
+    int result = 0;
     if (file) {
+        if (file->writable) {
+            result = retro_vfs_flush(stream);
+            std::lock_guard<std::mutex> lock(g_write_back_mutex);
+            auto it = g_writable_files.find(file->file_id);
+            if (it != g_writable_files.end()) {
+                auto& handles = it->second;
+                handles.erase(std::remove(handles.begin(), handles.end(), file), handles.end());
+                if (handles.empty()) {
+                    g_writable_files.erase(it);
+                    // No connection left to write them back with: they stay
+                    // dirty until the file is opened for writing again
+                    if (BlockCache::instance().has_dirty(file->file_id)) {
+                        printf("[LibretroVFS] Close kept unflushed blocks of %016llx for the next writer\n",
+                               (unsigned long long)file->file_id);
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
         if (file->fh) {
             std::lock_guard<std::mutex> lock(*file->context_mutex);
             nfs_close(file->nfs, file->fh);
         }
         if (file->nfs) NfsPool::instance().release(file->nfs);
+        PrefetchEngine::instance().remove_file(file->file_id);
         delete file;
     }
-    return 0;
+    return result;
+}
+
+// EOF as the cache knows it (updated by writes through any handle and by
+// short reads), falling back to the size seen at open.
+static uint64_t file_eof(RetroNfsFile* file) {
+    uint64_t size = file->size;
+    BlockCache::instance().file_size(file->file_id, &size);
+    return size;
 }
 
 static int64_t retro_vfs_size(struct retro_vfs_file_handle *stream) {
     if (!stream) return -1;
     RetroNfsFile* file = (RetroNfsFile*)stream;
-    return (int64_t)file->size;
+    return (int64_t)file_eof(file);
 }
 
 static int64_t retro_vfs_tell(struct retro_vfs_file_handle *stream) {
@@ -225,37 +500,126 @@ static int64_t retro_vfs_seek(struct retro_vfs_file_handle *stream, int64_t offs
     if (!stream) return -1;
     RetroNfsFile* file = (RetroNfsFile*)stream;
     int64_t target_offset = (int64_t)file->offset;
+    int64_t size = (int64_t)file_eof(file);
 
     switch (seek_position) {
         case RETRO_VFS_SEEK_POSITION_START:   target_offset = offset; break;
         case RETRO_VFS_SEEK_POSITION_CURRENT: target_offset += offset; break;
-        case RETRO_VFS_SEEK_POSITION_END:     target_offset = (int64_t)file->size + offset; break;
+        case RETRO_VFS_SEEK_POSITION_END:     target_offset = size + offset; break;
     }
 
     if (target_offset < 0) target_offset = 0;
-    if (target_offset > (int64_t)file->size) target_offset = (int64_t)file->size;
+    if (target_offset > size) target_offset = size;
 
     file->offset = (uint64_t)target_offset;
     return (int64_t)file->offset;
 }
 
-static int g_adaptive_timeout_ms = 4; // Start with 4ms
+// Readahead window cap, in KB; 0 (default) sizes it from the link
+static std::atomic<int> g_readahead_max_kb{0};
+static const uint32_t kMaxReadaheadBlocks = 64; // 8MB
+
+// The link as seen by synchronous READs: round-trip time (the fastest READ
+// lately less its transfer time, rising slowly) and throughput of
+// whole-block READs, in bytes/ms.
+// Races between readers only blur the estimate.
+static std::atomic<uint64_t> g_link_rtt_us{0};
+static std::atomic<uint64_t> g_link_bytes_per_ms{0};
+
+static void note_link_read(uint64_t bytes, uint64_t us) {
+    if (us == 0) us = 1;
+    // Round trip: the READ's time less what moving its bytes took
+    uint64_t rate = g_link_bytes_per_ms.load(std::memory_order_relaxed);
+    uint64_t transfer = rate != 0 ? bytes * 1000 / rate : 0;
+    uint64_t trip = us > transfer ? us - transfer : 1;
+    uint64_t rtt = g_link_rtt_us.load(std::memory_order_relaxed);
+    g_link_rtt_us.store(rtt == 0 || trip < rtt ? trip : rtt + (trip - rtt) / 32, std::memory_order_relaxed);
+    if (bytes >= BLOCK_SIZE) {
+        uint64_t sample = bytes * 1000 / us;
+        g_link_bytes_per_ms.store(rate == 0 ? sample : rate - rate / 8 + sample / 8, std::memory_order_relaxed);
+    }
+}
+
+// Largest readahead window, in blocks: twice the bandwidth-delay product,
+// since the next window is issued while the reader is still in this one
+static uint32_t readahead_max_blocks() {
+    int kb = g_readahead_max_kb.load(std::memory_order_relaxed);
+    uint64_t blocks = AccessPattern::kInitialWindow;
+    if (kb > 0) {
+        blocks = (uint64_t)kb * 1024 / BLOCK_SIZE;
+    } else {
+        uint64_t bdp = g_link_bytes_per_ms.load(std::memory_order_relaxed) *
+                       g_link_rtt_us.load(std::memory_order_relaxed) / 1000;
+        blocks = std::max<uint64_t>(blocks, (2 * bdp + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    }
+    return (uint32_t)std::max<uint64_t>(1, std::min<uint64_t>(blocks, kMaxReadaheadBlocks));
+}
+
+// What a one-block READ would have taken, given one of bytes took us
+static uint64_t block_fetch_us(uint64_t bytes, uint64_t us) {
+    uint64_t rate = g_link_bytes_per_ms.load(std::memory_order_relaxed);
+    if (bytes == 0 || bytes == BLOCK_SIZE || rate == 0) return us;
+    if (bytes < BLOCK_SIZE) return us + (BLOCK_SIZE - bytes) * 1000 / rate;
+    uint64_t extra = (bytes - BLOCK_SIZE) * 1000 / rate;
+    return std::max<uint64_t>(us > extra ? us - extra : 0, us * BLOCK_SIZE / bytes);
+}
+
+// Wait for block b if some fetcher has it in flight, as long as fetches
+// of this handle take; false when reading it ourselves is the better bet
+static bool wait_for_fetch(RetroNfsFile* file, uint64_t b) {
+    BlockCache& cache = BlockCache::instance();
+    uint64_t age = 0;
+    if (!cache.in_flight(file->file_id, b, &age)) return false;
+    // The fetch has been running for age already; wait out the rest
+    uint32_t expected = file->fetch_latency.wait_us();
+    uint32_t timeout = (uint32_t)std::max<uint64_t>(kMinFetchWaitUs, expected > age ? expected - age : 0);
+    auto begin = std::chrono::steady_clock::now();
+    bool arrived = cache.wait_for_block_us(file->file_id, b, timeout);
+    uint64_t waited = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - begin).count();
+    // Sample the whole fetch, from its claim: our wait is only its tail and
+    // would drag the estimate down to the floor. Later than expected: back
+    // the estimate off.
+    file->fetch_latency.sample(arrived ? age + waited : 2 * (age + waited));
+    return arrived;
+}
 
 static int64_t retro_vfs_read(struct retro_vfs_file_handle *stream, void *s, uint64_t len) {
     if (!stream || !s) return -1;
     RetroNfsFile* file = (RetroNfsFile*)stream;
     uint8_t* buf = (uint8_t*)s;
     uint64_t start_offset = file->offset;
+    Prefetcher prefetch = prefetcher_for(file);
+
+    // Known EOF: answer short reads and reads at the end without a round-trip.
+    // Unknown only if fstat failed at open; then the server decides.
+    uint64_t eof = UINT64_MAX;
+    BlockCache::instance().file_size(file->file_id, &eof);
+    if (start_offset >= eof) return 0;
+    if (len > eof - start_offset) len = eof - start_offset;
+    uint64_t eof_block = eof / BLOCK_SIZE + (eof % BLOCK_SIZE != 0); // first block past EOF
     
-    // Trigger prefetch for current and next blocks
-    if (g_prefetch_callback) {
-        uint64_t start_block = start_offset / BLOCK_SIZE;
-        g_prefetch_callback(start_block);
-        g_prefetch_callback(start_block + 1);
-        g_prefetch_callback(start_block + 2);
+    // Read ahead along the stream this read belongs to, once its pattern is
+    // confirmed; random access fetches only what it asks for. The window
+    // grows as the stream keeps going; see AccessPattern.
+    uint64_t start_block = start_offset / BLOCK_SIZE;
+    uint64_t end_block = (start_offset + (len ? len - 1 : 0)) / BLOCK_SIZE;
+    const AccessPattern::Stream& run = file->pattern.observe(start_block, end_block, readahead_max_blocks());
+    bool read_ahead = prefetch && run.confirmed();
+    if (read_ahead && run.issue_count > 0) {
+        if (run.issue_from == 1) {
+            // A window (re)starting here covers this read too
+            for (uint64_t b = start_block; b <= end_block; ++b) prefetch(b);
+        }
+        for (uint64_t k = run.issue_from; k < run.issue_from + run.issue_count; ++k) {
+            uint64_t b = run.predict(k);
+            if (b >= eof_block) break;
+            prefetch(b);
+        }
     }
 
     size_t total_read = 0;
+    bool at_eof = false;
     
     // Step 1: Try reading from cache. 
     // Optimization: Partial Hit Handling. 
@@ -264,47 +628,22 @@ static int64_t retro_vfs_read(struct retro_vfs_file_handle *stream, void *s, uin
     while (total_read < len) {
         size_t actual_copied = 0;
         uint64_t current_pos = file->offset + total_read;
-        int res = BlockCache::instance().read(current_pos, len - total_read, buf + total_read, &actual_copied);
+        int res = BlockCache::instance().read(file->file_id, current_pos, len - total_read, buf + total_read, &actual_copied);
         
         if (res > 0) {
             total_read += actual_copied;
             if (total_read >= len) break;
             
-            // If we didn't read everything, it means the next block is missing.
-            // Try to wait for it.
-            uint64_t missing_block_id = (file->offset + total_read) / BLOCK_SIZE;
-            
-            auto start_wait = std::chrono::steady_clock::now();
-            bool success = BlockCache::instance().wait_for_block(missing_block_id, g_adaptive_timeout_ms);
-            auto end_wait = std::chrono::steady_clock::now();
-            auto wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_wait - start_wait).count();
-
-            if (success) {
-                // Adjust adaptive timeout down if it was fast
-                if (wait_ms < g_adaptive_timeout_ms / 2 && g_adaptive_timeout_ms > 2) {
-                    g_adaptive_timeout_ms--;
-                }
-                // Continue loop to read the newly available block
-                continue;
-            } else {
-                // Timeout. 
-                // Adjust adaptive timeout up if we missed it
-                if (g_adaptive_timeout_ms < 20) g_adaptive_timeout_ms += 2;
-                
-                // Partial Hit: If we already read SOME data, return it now.
-                // Libretro usually calls again.
-                if (total_read > 0) break;
-                
-                // If we haven't read anything, fall through to sync read
-                break;
-            }
+            // The next block is missing: wait only if it is on its way
+            if (wait_for_fetch(file, (file->offset + total_read) / BLOCK_SIZE)) continue;
+            break; // Fall back to a sync read for the rest
+        } else if (res == 0) {
+            at_eof = true; // EOF moved below our position meanwhile
+            break;
         } else {
-            // First block missing, try wait once
-            uint64_t missing_block_id = current_pos / BLOCK_SIZE;
-            if (BlockCache::instance().wait_for_block(missing_block_id, g_adaptive_timeout_ms)) {
-                continue; // Try read again
-            }
-            break; // Fallback to sync
+            // First block missing: likewise
+            if (wait_for_fetch(file, current_pos / BLOCK_SIZE)) continue;
+            break;
         }
     }
 
@@ -312,16 +651,85 @@ static int64_t retro_vfs_read(struct retro_vfs_file_handle *stream, void *s, uin
     if (total_read < len) {
         uint64_t remaining_len = len - total_read;
         uint64_t current_pos = file->offset + total_read;
+        uint64_t req_end = current_pos + remaining_len;
+
+        // Round the miss out to aligned extents (e.g. the server's readmax),
+        // so one READ brings in the neighbourhood too. Needs a known EOF.
+        uint64_t fetch_pos = current_pos;
+        uint64_t fetch_end = req_end;
+        uint64_t extent = file->read_extent;
+        if (extent != 0 && eof != UINT64_MAX) {
+            fetch_pos = current_pos / extent * extent;
+            fetch_end = std::min<uint64_t>((req_end + extent - 1) / extent * extent, eof);
+        }
+        uint8_t* fetch_buf = buf + total_read;
+        if (fetch_pos != current_pos || fetch_end != req_end) {
+            thread_local std::vector<uint8_t> extent_buf;
+            extent_buf.resize(fetch_end - fetch_pos);
+            fetch_buf = extent_buf.data();
+        }
+
+        // Readahead should have brought this in: shrink the stream's window.
+        // Checked before claiming, which marks the block in flight itself.
+        if (read_ahead && !BlockCache::instance().in_flight(file->file_id, current_pos / BLOCK_SIZE)) {
+            file->pattern.miss(current_pos / BLOCK_SIZE);
+        }
+
+        // Claim the blocks this read fully covers, so a prefetcher asking for
+        // them meanwhile waits for our data instead of fetching them again.
+        // Reaching EOF covers the file's tail block too.
+        uint64_t first_full = (fetch_pos + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        uint64_t end_full = fetch_end == eof ? eof_block : fetch_end / BLOCK_SIZE; // exclusive
+        std::vector<uint64_t> claimed;
+        for (uint64_t b = first_full; b < end_full; ++b) {
+            if (BlockCache::instance().claim_block(file->file_id, b) == BlockCache::kClaimed) {
+                claimed.push_back(b);
+            }
+        }
+
         int sync_res = 0;
+        auto fetch_begin = std::chrono::steady_clock::now();
         {
             std::lock_guard<std::mutex> lock(*file->context_mutex);
-            sync_res = nfs_pread(file->nfs, file->fh, buf + total_read, remaining_len, current_pos);
+            sync_res = nfs_pread(file->nfs, file->fh, fetch_buf, fetch_end - fetch_pos, fetch_pos);
+        }
+        if (sync_res > 0) {
+            uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - fetch_begin).count();
+            note_link_read(sync_res, us);
+            file->fetch_latency.sample(block_fetch_us(sync_res, us));
         }
 
+        uint64_t sync_end = fetch_pos + (sync_res > 0 ? sync_res : 0);
         if (sync_res > 0) {
-            // Predictive Backfilling / Predictive Filling
-            // If we read a significant amount or exactly aligned blocks, put them in cache.
-            uint64_t sync_end = current_pos + sync_res;
+            // Writes not yet written back are newer than what the server sent
+            BlockCache::instance().overlay_dirty(file->file_id, fetch_pos, fetch_buf, sync_res);
+        }
+        if (sync_res >= 0 && sync_end <= current_pos && !BlockCache::instance().has_dirty(file->file_id)) {
+            // The file shrank on the server since we last looked
+            at_eof = true;
+            BlockCache::instance().set_file_size(file->file_id, sync_end);
+        }
+        for (uint64_t b : claimed) {
+            uint64_t b_start = b * BLOCK_SIZE;
+            uint64_t b_end = std::min<uint64_t>(b_start + BLOCK_SIZE, eof);
+            if (sync_end >= b_end) {
+                BlockCache::instance().complete_block(file->file_id, b, fetch_buf + (b_start - fetch_pos), b_end - b_start);
+            } else {
+                BlockCache::instance().fail_block(file->file_id, b);
+            }
+        }
+
+        if (sync_end > current_pos) {
+            // Keep the rest of the READ too, down to whole 4KB sub-blocks
+            BlockCache::instance().put_range(file->file_id, fetch_pos, fetch_buf, sync_res);
+            size_t got = (size_t)(std::min(sync_end, req_end) - current_pos);
+            if (fetch_buf != buf + total_read) {
+                memcpy(buf + total_read, fetch_buf + (current_pos - fetch_pos), got);
+            }
+
+            // Predictive Filling: blocks only partially covered by this read
+            // are handed to the background prefetcher.
             uint64_t first_block = current_pos / BLOCK_SIZE;
             uint64_t last_block = (sync_end - 1) / BLOCK_SIZE;
 
@@ -329,19 +737,16 @@ static int64_t retro_vfs_read(struct retro_vfs_file_handle *stream, void *s, uin
                 uint64_t b_start = b * BLOCK_SIZE;
                 uint64_t b_end = b_start + BLOCK_SIZE;
                 
-                // Only backfill if we have the WHOLE block data in this sync read
-                if (current_pos <= b_start && sync_end >= b_end) {
-                    size_t buf_offset = b_start - current_pos;
-                    BlockCache::instance().put_block(b, buf + total_read + buf_offset, BLOCK_SIZE);
-                    // printf("[LibretroVFS] Backfilled block %llu from large sync read\n", b);
-                } else if (sync_res < BLOCK_SIZE && g_prefetch_callback) {
+                if (fetch_pos <= b_start && (sync_end >= b_end || sync_end == eof)) {
+                    continue; // Backfilled above
+                } else if (sync_res < BLOCK_SIZE && read_ahead) {
                     // If it was a small read, trigger background prefetch for the containing block
                     // so next time it's in cache.
-                    g_prefetch_callback(b);
+                    prefetch(b);
                 }
             }
             
-            total_read += sync_res;
+            total_read += got;
         }
     }
 
@@ -349,31 +754,97 @@ static int64_t retro_vfs_read(struct retro_vfs_file_handle *stream, void *s, uin
         file->offset += total_read;
         return (int64_t)total_read;
     }
-    
-    return -1;
+    return at_eof ? 0 : -1;
 }
 
-static int64_t retro_vfs_write(struct retro_vfs_file_handle *stream, const void *s, uint64_t len) {
-    if (!stream) return -1;
-    RetroNfsFile* file = (RetroNfsFile*)stream;
+static bool fill_block(RetroNfsFile* file, uint64_t b) {
+    BlockCache& cache = BlockCache::instance();
+    BlockCache::ClaimResult claim = cache.claim_block(file->file_id, b);
+    if (claim == BlockCache::kPresent) return true;
+    if (claim == BlockCache::kInFlight) return cache.wait_for_block_us(file->file_id, b, file->fetch_latency.wait_us());
+
+    // READ straight into the reserved slot when there is one
+    thread_local std::vector<uint8_t> block(BLOCK_SIZE);
+    uint8_t* slot = cache.claim_buffer(file->file_id, b);
     int res = 0;
     {
         std::lock_guard<std::mutex> lock(*file->context_mutex);
-        res = nfs_pwrite(file->nfs, file->fh, (void*)s, len, file->offset);
+        res = nfs_pread(file->nfs, file->fh, slot ? slot : block.data(), BLOCK_SIZE, b * BLOCK_SIZE);
     }
-    if (res > 0) {
-        // Invalidate cache for the overwritten range
-        uint64_t start_block = file->offset / BLOCK_SIZE;
-        uint64_t end_block = (file->offset + res - 1) / BLOCK_SIZE;
-        for (uint64_t b = start_block; b <= end_block; ++b) {
-            BlockCache::instance().invalidate_block(b);
+    if (res < 0) {
+        cache.fail_block(file->file_id, b);
+        return false;
+    }
+    if (slot) {
+        cache.commit_block(file->file_id, b, res);
+    } else {
+        cache.complete_block(file->file_id, b, block.data(), res);
+    }
+    return true;
+}
+
+static int64_t retro_vfs_write(struct retro_vfs_file_handle *stream, const void *s, uint64_t len) {
+    if (!stream || !s) return -1;
+    RetroNfsFile* file = (RetroNfsFile*)stream;
+    const uint8_t* data = (const uint8_t*)s;
+    BlockCache& cache = BlockCache::instance();
+    if (len == 0) return 0;
+    file->written = true;
+
+    if (g_write_back.load(std::memory_order_relaxed) && file->writable && file->offset <= file_eof(file)) {
+        if (absorb_write(file, data, len)) {
+            file->offset += len;
+            if (file->offset > file->size) file->size = file->offset;
+            if (cache.dirty_bytes() > g_max_dirty_bytes.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(g_write_back_mutex);
+                flush_dirty_locked(file);
+            }
+            return (int64_t)len;
         }
+        // Written through below; what was absorbed must not land after it
+        std::lock_guard<std::mutex> lock(g_write_back_mutex);
+        flush_dirty_locked(file);
+    }
+
+    int res = 0;
+    if (g_delta_writes.load(std::memory_order_relaxed)) {
+        res = delta_pwrite(file->nfs, file->fh, file->context_mutex, file->file_id, data, len, file->offset);
+    } else {
+        {
+            std::lock_guard<std::mutex> lock(*file->context_mutex);
+            res = nfs_pwrite(file->nfs, file->fh, (void*)s, len, file->offset);
+        }
+        if (res > 0) cache.write_through(file->file_id, file->offset, data, res);
+    }
+    if (res > 0) {
         file->offset += res;
+        if (file->offset > file->size) file->size = file->offset;
+        if (file->offset > file_eof(file)) BlockCache::instance().set_file_size(file->file_id, file->offset);
     }
     return res;
 }
 
-static int retro_vfs_flush(struct retro_vfs_file_handle *stream) { return 0; }
+static int retro_vfs_flush(struct retro_vfs_file_handle *stream) {
+    if (!stream) return -1;
+    RetroNfsFile* file = (RetroNfsFile*)stream;
+    if (!file->written) return 0;
+    {
+        std::lock_guard<std::mutex> lock(g_write_back_mutex);
+        if (flush_dirty_locked(file) != 0) return -1;
+    }
+    // COMMIT: make the server's copy stable, not just received
+    std::lock_guard<std::mutex> lock(*file->context_mutex);
+    if (nfs_fsync(file->nfs, file->fh) != 0) return -1;
+    file->written = false;
+    // Record the change attribute our writes produced, so that reopening
+    // the file does not take them for a modification made elsewhere
+    struct nfs_stat_64 st;
+    if (nfs_fstat64(file->nfs, file->fh, &st) == 0 && !BlockCache::instance().has_dirty(file->file_id)) {
+        BlockCache::instance().set_file_change(file->file_id,
+            BlockCache::make_change_attr(st.nfs_size, st.nfs_mtime, st.nfs_mtime_nsec));
+    }
+    return 0;
+}
 static int retro_vfs_remove(const char *path) { return -1; }
 static int retro_vfs_rename(const char *old_path, const char *new_path) { return -1; }
 
@@ -474,6 +945,61 @@ static struct retro_vfs_interface g_nfs_vfs = {
 };
 
 extern "C" {
+    // Enable write-back for VFS writes (disabled by default). Durability:
+    // - A write that returns success is only in memory until written back.
+    // - Dirty data is written back, in WRITEs of up to 1MB covering adjacent
+    //   blocks, when retro_vfs_flush or retro_vfs_close is called (followed
+    //   by a COMMIT; they return 0 only once the data is stable on the
+    //   server), when it is older than flush_interval_ms, when more than
+    //   max_dirty_mb is dirty, and on cache_trim at level 1 or above.
+    // - A failed write-back keeps the data dirty and is retried by the next
+    //   flush; flush and close return -1. If the last handle of the file
+    //   closes that way, the data stays dirty in the cache (readable, never
+    //   evicted) and is written back when the file is next opened for
+    //   writing. Data is lost if the process dies first.
+    // - Other handles in this process read dirty data right away.
+    // Disabling writes back all dirty data first.
+    EXPORT void nfs_vfs_set_write_back(int enabled, int flush_interval_ms, int max_dirty_mb) {
+        if (flush_interval_ms > 0) g_flush_interval_ms = (uint32_t)flush_interval_ms;
+        if (max_dirty_mb > 0) g_max_dirty_bytes = (size_t)max_dirty_mb * 1024 * 1024;
+        if (enabled) {
+            BlockCache::instance().set_flush_handler(flush_all_dirty);
+            std::call_once(g_flusher_once, [] { std::thread(flusher_loop).detach(); });
+            g_write_back = true;
+        } else if (g_write_back.exchange(false)) {
+            flush_all_dirty();
+        }
+    }
+
+    // Send only the changed ranges of write-through writes that rewrite
+    // cached data, e.g. a savestate saved over its previous version. Writes
+    // absorbed by write-back are unaffected.
+    EXPORT void nfs_vfs_set_delta_writes(int enabled) {
+        g_delta_writes = enabled != 0;
+    }
+
+    // Charge files opened from now on to a cache partition created with
+    // cache_create_partition (0: the default partition), so e.g. the running
+    // game keeps its blocks while a library scan streams through the cache.
+    EXPORT void nfs_vfs_set_partition(int partition) {
+        g_cache_partition = partition >= 0 && partition < BlockCache::kMaxPartitions ? partition : 0;
+    }
+
+    // Round synchronous read misses of files opened from now on out to
+    // aligned extents of kb KB (-1: the server's readmax, 0: off), capped at
+    // BlockCache::kMaxExtent. Files given an extent of their own with
+    // cache_file_set_extent keep it.
+    EXPORT void nfs_vfs_set_read_extent(int kb) {
+        g_read_extent_kb = kb < 0 ? -1 : kb;
+    }
+
+    // Cap the readahead window of confirmed streams at kb KB (at most 8MB);
+    // 0 (default) derives it from the bandwidth-delay product measured on
+    // synchronous READs
+    EXPORT void nfs_vfs_set_readahead_max(int kb) {
+        g_readahead_max_kb = kb < 0 ? 0 : kb;
+    }
+
     EXPORT struct retro_vfs_interface* get_libretro_vfs() {
         return &g_nfs_vfs;
     }
@@ -0,0 +1,162 @@
+#include "lz_codec.hpp"
+#include <string.h>
+
+namespace lz {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5; // the block always ends with literals
+constexpr size_t kMatchFindLimit = 12;
+constexpr size_t kMaxOffset = 65535;
+
+inline uint32_t read32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+inline uint64_t read64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+// Length of the common prefix of p and ref, stopping at limit
+inline size_t match_length(const uint8_t* p, const uint8_t* ref, const uint8_t* limit) {
+    const uint8_t* start = p;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (p + 8 <= limit) {
+        uint64_t diff = read64(p) ^ read64(ref);
+        if (diff != 0) return (p - start) + (__builtin_ctzll(diff) >> 3);
+        p += 8;
+        ref += 8;
+    }
+#endif
+    while (p < limit && *p == *ref) { p++; ref++; }
+    return p - start;
+}
+
+inline uint32_t hash(uint32_t v) {
+    return (v * 2654435761U) >> (32 - CompressState::kHashLog);
+}
+
+// Writes the 15+ extension bytes of a length. Returns false on overflow.
+inline bool put_length(uint8_t** op, const uint8_t* oend, size_t len) {
+    while (len >= 255) {
+        if (*op >= oend) return false;
+        *(*op)++ = 255;
+        len -= 255;
+    }
+    if (*op >= oend) return false;
+    *(*op)++ = static_cast<uint8_t>(len);
+    return true;
+}
+
+// Emit one sequence: literals [anchor, anchor+lit_len) then a match (if
+// match_len > 0). Returns false if dst is too small.
+inline bool emit(uint8_t** op, const uint8_t* oend, const uint8_t* anchor, size_t lit_len,
+                 size_t offset, size_t match_len) {
+    uint8_t* token = (*op)++;
+    if (token >= oend) return false;
+    *token = static_cast<uint8_t>((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15 && !put_length(op, oend, lit_len - 15)) return false;
+    if ((size_t)(oend - *op) < lit_len) return false;
+    memcpy(*op, anchor, lit_len);
+    *op += lit_len;
+    if (match_len == 0) return true;
+
+    if (oend - *op < 2) return false;
+    *(*op)++ = static_cast<uint8_t>(offset);
+    *(*op)++ = static_cast<uint8_t>(offset >> 8);
+    size_t ml = match_len - kMinMatch;
+    *token |= static_cast<uint8_t>(ml >= 15 ? 15 : ml);
+    if (ml >= 15 && !put_length(op, oend, ml - 15)) return false;
+    return true;
+}
+
+} // namespace
+
+size_t compress(CompressState* state, const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_capacity) {
+    uint8_t* op = dst;
+    const uint8_t* oend = dst + dst_capacity;
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* iend = src + src_len;
+
+    if (src_len >= kMatchFindLimit + 1) {
+        memset(state->table, 0, sizeof(state->table));
+        const uint8_t* mflimit = iend - kMatchFindLimit;
+        const uint8_t* matchlimit = iend - kLastLiterals;
+        ip++;
+        while (ip < mflimit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash(seq);
+            const uint8_t* ref = src + state->table[h];
+            state->table[h] = static_cast<uint32_t>(ip - src);
+            if (ref >= ip || (size_t)(ip - ref) > kMaxOffset || read32(ref) != seq) {
+                // Skip faster through data that does not match
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            // Extend backwards over equal bytes, then forwards
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) { ip--; ref--; }
+            const uint8_t* mp = ip + kMinMatch;
+            mp += match_length(mp, ref + kMinMatch, matchlimit);
+
+            if (!emit(&op, oend, anchor, ip - anchor, ip - ref, mp - ip)) return 0;
+            ip = mp;
+            anchor = ip;
+            if (ip < mflimit) state->table[hash(read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - src);
+        }
+    }
+
+    if (!emit(&op, oend, anchor, iend - anchor, 0, 0)) return 0;
+    return op - dst;
+}
+
+int decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_capacity) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_capacity;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                lit_len += b;
+            } while (b == 255);
+        }
+        if ((size_t)(iend - ip) < lit_len || (size_t)(oend - op) < lit_len) return -1;
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        if (ip == iend) break; // last sequence has no match
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return -1;
+        size_t match_len = token & 15;
+        if (match_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += kMinMatch;
+        if ((size_t)(oend - op) < match_len) return -1;
+        // An overlapping match repeats the last offset bytes; copy in chunks
+        // that double as the repeated region grows
+        const uint8_t* match = op - offset;
+        uint8_t* match_end = op + match_len;
+        while (op < match_end) {
+            size_t chunk = op - match;
+            if (chunk > (size_t)(match_end - op)) chunk = match_end - op;
+            memcpy(op, match, chunk);
+            op += chunk;
+        }
+    }
+    return static_cast<int>(op - dst);
+}
+
+} // namespace lz
@@ -0,0 +1,27 @@
+#ifndef LZ_CODEC_HPP
+#define LZ_CODEC_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Built-in LZ4-compatible block codec (raw LZ4 block format, no frame):
+// greedy single-probe matching for speed, bounds-checked decoding.
+namespace lz {
+
+// Scratch for lz::compress; reuse it across calls to avoid reallocating.
+struct CompressState {
+    static constexpr int kHashLog = 14;
+    uint32_t table[1 << kHashLog];
+};
+
+// Compress src into dst. Returns the compressed size, or 0 if it would not
+// fit in dst_capacity (e.g. the input is incompressible).
+size_t compress(CompressState* state, const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_capacity);
+
+// Decompress src into dst. Returns the decompressed size, or -1 if the input
+// is malformed or would overflow dst_capacity.
+int decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_capacity);
+
+} // namespace lz
+
+#endif // LZ_CODEC_HPP
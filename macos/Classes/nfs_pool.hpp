@@ -37,8 +37,11 @@ public:
         bool valid = false;
     };
 
-    ConnectionHandle acquire(const std::string& server, const std::string& export_path) {
+    // lane > 0 selects a connection of its own to the same export, e.g. for
+    // background fetching that must not queue behind the foreground's RPCs
+    ConnectionHandle acquire(const std::string& server, const std::string& export_path, int lane = 0) {
         std::string key = server + ":" + export_path;
+        if (lane > 0) key += "#" + std::to_string(lane);
         
         {
             std::lock_guard<std::mutex> lock(pool_mutex_);
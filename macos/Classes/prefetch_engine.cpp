@@ -0,0 +1,407 @@
+#include "prefetch_engine.hpp"
+#include "block_cache.hpp"
+#include "block_key.hpp"
+#include "nfs_pool.hpp"
+#include <nfsc/libnfs.h>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <memory>
+#include <poll.h>
+#include <stdio.h>
+
+#if defined(__APPLE__) || defined(__GNUC__)
+#define EXPORT __attribute__((visibility("default"))) __attribute__((used))
+#else
+#define EXPORT
+#endif
+
+PrefetchEngine& PrefetchEngine::instance() {
+    static PrefetchEngine instance;
+    return instance;
+}
+
+PrefetchEngine::PrefetchEngine() {
+    // Constructed first, so destroyed after the workers are joined
+    NfsPool::instance();
+    BlockCache::instance();
+    for (size_t i = 0; i < kQueueSize; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    for (auto& key : recent_) key.store(0, std::memory_order_relaxed);
+}
+
+PrefetchEngine::~PrefetchEngine() {
+    stop_workers();
+}
+
+void PrefetchEngine::start(int workers) {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    stop_workers();
+    workers = std::max(0, std::min(workers, kMaxWorkers));
+    for (int i = 0; i < workers; ++i) threads_.emplace_back(&PrefetchEngine::run, this, i + 1);
+    workers_.store(workers, std::memory_order_relaxed);
+    printf("[PrefetchEngine] %d workers\n", workers);
+    fflush(stdout);
+}
+
+void PrefetchEngine::stop_workers() {
+    if (threads_.empty()) return;
+    workers_.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stop_.store(true);
+    }
+    wake_.notify_all();
+    for (std::thread& t : threads_) t.join();
+    threads_.clear();
+    stop_.store(false);
+}
+
+void PrefetchEngine::add_file(uint64_t file_id, const std::string& server, const std::string& export_path,
+                              const std::string& path) {
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    FileEntry& entry = files_[file_id];
+    if (entry.refs++ > 0) return;
+    entry.server = server;
+    entry.export_path = export_path;
+    entry.path = path;
+    entry.epoch = next_epoch_++;
+}
+
+void PrefetchEngine::remove_file(uint64_t file_id) {
+    std::lock_guard<std::mutex> lock(files_mutex_);
+    auto it = files_.find(file_id);
+    if (it != files_.end() && --it->second.refs <= 0) files_.erase(it);
+}
+
+// Tag of a request in recent_; never 0, which marks a free entry
+static uint64_t recent_key(uint64_t file_id, uint64_t block_id) {
+    uint64_t key = BlockKeyHash()({file_id, block_id});
+    return key != 0 ? key : 1;
+}
+
+// --- Queue: bounded MPMC ring (D. Vyukov) ---
+
+bool PrefetchEngine::push(const Request& req) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells_[pos & (kQueueSize - 1)];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.req = req;
+                cell.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool PrefetchEngine::pop(Request* out) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells_[pos & (kQueueSize - 1)];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                *out = cell.req;
+                cell.seq.store(pos + kQueueSize, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // empty
+        } else {
+            pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool PrefetchEngine::queue_empty() const {
+    return enqueue_pos_.load() == dequeue_pos_.load();
+}
+
+bool PrefetchEngine::enqueue(uint64_t file_id, uint64_t block_id) {
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    if (!running()) return false;
+    uint64_t key = recent_key(file_id, block_id);
+    std::atomic<uint64_t>& recent = recent_[key % kRecentSize];
+    // Set before pushing: the worker clears it when it takes the request
+    if (recent.exchange(key, std::memory_order_relaxed) == key) {
+        coalesced_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (!push({file_id, block_id})) {
+        recent.compare_exchange_strong(key, 0, std::memory_order_relaxed);
+        overflows_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (sleepers_.load() > 0) {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        wake_.notify_one();
+    }
+    return true;
+}
+
+// --- Workers ---
+
+// A READ in flight, completed into the cache by on_read
+struct PrefetchEngine::Read {
+    PrefetchEngine* engine = nullptr;
+    uint64_t file_id = 0;
+    uint64_t block_id = 0;
+    struct nfs_context* nfs = nullptr;
+    struct nfsfh* fh = nullptr;
+    uint8_t* slot = nullptr; // claimed slot, else into buffer
+    std::vector<uint8_t> buffer;
+    std::chrono::steady_clock::time_point begin;
+    bool busy = false; // issued, not reaped yet
+    bool done = false; // callback ran
+};
+
+void PrefetchEngine::set_depth(int depth) {
+    depth_.store(std::max(1, std::min(depth, kMaxDepth)), std::memory_order_relaxed);
+}
+
+void PrefetchEngine::on_read(int status, struct nfs_context* /*nfs*/, void* /*data*/, void* private_data) {
+    Read* read = static_cast<Read*>(private_data);
+    PrefetchEngine* engine = read->engine;
+    BlockCache& cache = BlockCache::instance();
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - read->begin);
+    if (status < 0) {
+        cache.fail_block(read->file_id, read->block_id);
+        engine->failed_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        if (read->slot) {
+            cache.commit_block(read->file_id, read->block_id, status);
+        } else {
+            cache.complete_block(read->file_id, read->block_id, read->buffer.data(), status);
+        }
+        engine->fetched_.fetch_add(1, std::memory_order_relaxed);
+        engine->fetched_bytes_.fetch_add(status, std::memory_order_relaxed);
+        engine->fetch_us_.fetch_add(us.count(), std::memory_order_relaxed);
+    }
+    read->done = true;
+}
+
+void PrefetchEngine::run(int lane) {
+    struct OpenFile {
+        NfsPool::ConnectionHandle conn;
+        struct nfsfh* fh; // nullptr: could not be opened
+        uint64_t epoch;
+    };
+    std::unordered_map<std::string, NfsPool::ConnectionHandle> conns;
+    std::unordered_map<uint64_t, OpenFile> open;
+    std::vector<OpenFile> closing; // replaced while READs were in flight on them
+    std::vector<std::unique_ptr<Read>> reads;
+    std::unordered_map<struct nfs_context*, int> conn_reads; // in flight per connection
+    int in_flight = 0;
+    BlockCache& cache = BlockCache::instance();
+
+    auto close_fh = [](const OpenFile& file) {
+        if (file.fh) {
+            std::lock_guard<std::mutex> lock(*file.conn.mutex);
+            nfs_close(file.conn.nfs, file.fh);
+        }
+    };
+    // A handle is closed only once no READ is in flight on it
+    auto close_file = [&](std::unordered_map<uint64_t, OpenFile>::iterator it) {
+        if (in_flight > 0) {
+            closing.push_back(it->second);
+        } else {
+            close_fh(it->second);
+        }
+        open.erase(it);
+    };
+
+    // Handle of file_id on this worker's connection, opened on first use.
+    // nullptr once the file was removed or if it cannot be opened.
+    auto handle_for = [&](uint64_t file_id) -> OpenFile* {
+        FileEntry entry;
+        {
+            std::lock_guard<std::mutex> lock(files_mutex_);
+            auto it = files_.find(file_id);
+            if (it == files_.end()) return nullptr;
+            auto cached = open.find(file_id);
+            if (cached != open.end() && cached->second.epoch == it->second.epoch) {
+                return cached->second.fh ? &cached->second : nullptr;
+            }
+            entry = it->second;
+        }
+        auto cached = open.find(file_id);
+        if (cached != open.end()) close_file(cached);
+
+        std::string key = entry.server + ":" + entry.export_path;
+        auto conn = conns.find(key);
+        if (conn == conns.end()) {
+            NfsPool::ConnectionHandle handle = NfsPool::instance().acquire(entry.server, entry.export_path, lane);
+            if (!handle.nfs) return nullptr;
+            {
+                std::lock_guard<std::mutex> lock(*handle.mutex);
+                nfs_set_timeout(handle.nfs, kRpcTimeoutMs);
+            }
+            conn = conns.emplace(key, handle).first;
+        }
+        struct nfsfh* fh = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(*conn->second.mutex);
+            if (nfs_open(conn->second.nfs, entry.path.c_str(), O_RDONLY, &fh) != 0) {
+                printf("[PrefetchEngine] Cannot open %s: %s\n", entry.path.c_str(), nfs_get_error(conn->second.nfs));
+                fflush(stdout);
+                fh = nullptr;
+            }
+        }
+        OpenFile& file = open[file_id];
+        file = {conn->second, fh, entry.epoch};
+        return fh ? &file : nullptr;
+    };
+
+    // Close handles of files removed (or reopened) since
+    auto sweep = [&] {
+        std::vector<uint64_t> stale;
+        {
+            std::lock_guard<std::mutex> lock(files_mutex_);
+            for (const auto& it : open) {
+                auto entry = files_.find(it.first);
+                if (entry == files_.end() || entry->second.epoch != it.second.epoch) stale.push_back(it.first);
+            }
+        }
+        for (uint64_t file_id : stale) close_file(open.find(file_id));
+    };
+
+    // Claim the block and issue its READ; false if there was nothing to do
+    auto issue = [&](const Request& req) {
+        uint64_t eof = UINT64_MAX;
+        cache.file_size(req.file_id, &eof);
+        uint64_t start = req.block_id * BLOCK_SIZE;
+        OpenFile* file = start < eof ? handle_for(req.file_id) : nullptr;
+        if (!file || cache.claim_block(req.file_id, req.block_id) != BlockCache::kClaimed) return false;
+
+        auto it = std::find_if(reads.begin(), reads.end(), [](const std::unique_ptr<Read>& r) { return !r->busy; });
+        if (it == reads.end()) it = reads.insert(reads.end(), std::unique_ptr<Read>(new Read()));
+        Read* read = it->get();
+        read->engine = this;
+        read->file_id = req.file_id;
+        read->block_id = req.block_id;
+        read->nfs = file->conn.nfs;
+        read->fh = file->fh;
+        read->done = false;
+
+        // READ straight into the reserved slot when there is one
+        size_t want = (size_t)std::min<uint64_t>(BLOCK_SIZE, eof - start);
+        read->slot = cache.claim_buffer(req.file_id, req.block_id);
+        if (!read->slot) read->buffer.resize(BLOCK_SIZE);
+        uint8_t* dst = read->slot ? read->slot : read->buffer.data();
+        read->begin = std::chrono::steady_clock::now();
+        int rc = 0;
+        {
+            std::lock_guard<std::mutex> lock(*file->conn.mutex);
+            rc = nfs_pread_async(file->conn.nfs, file->fh, dst, want, start, on_read, read);
+        }
+        if (rc != 0) {
+            cache.fail_block(req.file_id, req.block_id);
+            failed_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        read->busy = true;
+        in_flight++;
+        conn_reads[read->nfs]++;
+        return true;
+    };
+
+    // Wait for the connections with READs in flight and run their callbacks
+    auto service = [&] {
+        std::vector<struct pollfd> fds;
+        std::vector<NfsPool::ConnectionHandle> polled;
+        for (const auto& conn : conns) {
+            if (conn_reads[conn.second.nfs] == 0) continue;
+            std::lock_guard<std::mutex> lock(*conn.second.mutex);
+            struct pollfd pfd;
+            pfd.fd = nfs_get_fd(conn.second.nfs);
+            pfd.events = nfs_which_events(conn.second.nfs);
+            pfd.revents = 0;
+            fds.push_back(pfd);
+            polled.push_back(conn.second);
+        }
+        if (poll(fds.data(), fds.size(), 10) < 0) return;
+        for (size_t i = 0; i < fds.size(); ++i) {
+            std::lock_guard<std::mutex> lock(*polled[i].mutex);
+            if (nfs_service(polled[i].nfs, fds[i].revents) < 0) {
+                // READs on it still complete, failed, once they time out
+                printf("[PrefetchEngine] Connection error: %s\n", nfs_get_error(polled[i].nfs));
+                fflush(stdout);
+            }
+        }
+        for (auto& read : reads) {
+            if (!read->busy || !read->done) continue;
+            read->busy = false;
+            in_flight--;
+            conn_reads[read->nfs]--;
+        }
+    };
+
+    for (;;) {
+        bool stopping = stop_.load(std::memory_order_acquire);
+        int depth = depth_.load(std::memory_order_relaxed);
+        Request req;
+        while (!stopping && in_flight < depth && pop(&req)) {
+            uint64_t key = recent_key(req.file_id, req.block_id);
+            recent_[key % kRecentSize].compare_exchange_strong(key, 0, std::memory_order_relaxed);
+            if (!issue(req)) skipped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (in_flight > 0) {
+            // Also drains READs in flight when stopping: their buffers must
+            // outlive them
+            service();
+            continue;
+        }
+        for (const OpenFile& file : closing) close_fh(file);
+        closing.clear();
+        if (stopping) break;
+        if (!queue_empty()) continue;
+
+        sweep();
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        sleepers_.fetch_add(1);
+        wake_.wait_for(lock, std::chrono::milliseconds(100), [this] {
+            return stop_.load() || !queue_empty();
+        });
+        sleepers_.fetch_sub(1);
+    }
+
+    while (!open.empty()) close_file(open.begin());
+    for (auto& conn : conns) NfsPool::instance().release(conn.second.nfs);
+}
+
+PrefetchStats PrefetchEngine::stats() const {
+    PrefetchStats out;
+    out.requests = requests_.load(std::memory_order_relaxed);
+    out.coalesced = coalesced_.load(std::memory_order_relaxed);
+    out.overflows = overflows_.load(std::memory_order_relaxed);
+    out.fetched = fetched_.load(std::memory_order_relaxed);
+    out.skipped = skipped_.load(std::memory_order_relaxed);
+    out.failed = failed_.load(std::memory_order_relaxed);
+    out.fetched_bytes = fetched_bytes_.load(std::memory_order_relaxed);
+    out.fetch_us = fetch_us_.load(std::memory_order_relaxed);
+    out.workers = workers_.load(std::memory_order_relaxed);
+    out.depth = depth_.load(std::memory_order_relaxed);
+    return out;
+}
+
+extern "C" {
+    EXPORT void nfs_prefetch_start(int workers) {
+        PrefetchEngine::instance().start(workers);
+    }
+
+    EXPORT void nfs_prefetch_set_depth(int depth) {
+        PrefetchEngine::instance().set_depth(depth);
+    }
+
+    EXPORT void nfs_prefetch_get_stats(PrefetchStats* out) {
+        if (out) *out = PrefetchEngine::instance().stats();
+    }
+}
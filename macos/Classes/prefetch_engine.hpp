@@ -0,0 +1,141 @@
+#ifndef PREFETCH_ENGINE_HPP
+#define PREFETCH_ENGINE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct nfs_context;
+
+// Counters exposed through nfs_prefetch_get_stats (C layout, mirrored in Dart)
+struct PrefetchStats {
+    uint64_t requests;      // blocks asked for through enqueue
+    uint64_t coalesced;     // of those, dropped because already queued
+    uint64_t overflows;     // of those, dropped because the queue was full
+    uint64_t fetched;       // blocks read into the cache
+    uint64_t skipped;       // dequeued blocks cached, in flight or past EOF by then
+    uint64_t failed;        // READs that failed
+    uint64_t fetched_bytes; // bytes of the blocks fetched
+    uint64_t fetch_us;      // time spent in those READs, summed though they overlap
+    uint64_t workers;       // threads running
+    uint64_t depth;         // READs each worker keeps in flight
+};
+
+// Background readahead for the libretro VFS, native end to end. The read
+// path queues blocks on a bounded lock-free ring; a small pool of worker
+// threads claims them in BlockCache and READs them straight into their slots.
+// Each worker has NfsPool connections of its own, so prefetching never waits
+// for the foreground's context mutex, and keeps up to depth READs in flight
+// on them, completing each into the cache from its callback; one READ per
+// round trip would cap a worker at a block per RTT. Files must be made known
+// with add_file so workers can open them on their connections.
+class PrefetchEngine {
+public:
+    static PrefetchEngine& instance();
+
+    static constexpr int kMaxWorkers = 8;
+    static constexpr int kMaxDepth = 32;
+
+    // Run workers fetch threads (at most kMaxWorkers), replacing the running
+    // ones; 0 stops the engine. Queued requests are kept.
+    void start(int workers);
+    bool running() const { return workers_.load(std::memory_order_relaxed) > 0; }
+
+    // READs each worker keeps in flight (1..kMaxDepth); applies right away
+    void set_depth(int depth);
+
+    // Where workers open file_id; counted, one remove_file per add_file
+    void add_file(uint64_t file_id, const std::string& server, const std::string& export_path,
+                  const std::string& path);
+    void remove_file(uint64_t file_id);
+
+    // Queue a block for fetching. Lock-free and never blocks, for the read
+    // path; false if it was dropped (already queued, queue full, stopped).
+    bool enqueue(uint64_t file_id, uint64_t block_id);
+
+    PrefetchStats stats() const;
+
+private:
+    struct Request {
+        uint64_t file_id;
+        uint64_t block_id;
+    };
+
+    // Ring cell; seq tells producers and consumers whose turn it is
+    struct Cell {
+        std::atomic<size_t> seq;
+        Request req;
+    };
+
+    struct FileEntry {
+        std::string server;
+        std::string export_path;
+        std::string path;
+        int refs = 0;
+        uint64_t epoch = 0; // tells a reopened file from its earlier handles
+    };
+
+    struct Read;
+
+    static constexpr size_t kQueueSize = 1024; // power of two
+    static constexpr size_t kRecentSize = 256;
+    static constexpr int kDefaultDepth = 8;
+    static constexpr int kRpcTimeoutMs = 10000; // so every READ completes
+
+    PrefetchEngine();
+    ~PrefetchEngine();
+
+    bool push(const Request& req);
+    bool pop(Request* out);
+    bool queue_empty() const;
+    void run(int lane);
+    static void on_read(int status, struct nfs_context* nfs, void* data, void* private_data);
+    void stop_workers();
+
+    Cell cells_[kQueueSize];
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+    // Keys queued recently, so the read path asking for the same blocks on
+    // every call does not fill the ring with duplicates
+    std::atomic<uint64_t> recent_[kRecentSize];
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<int> sleepers_{0};
+
+    std::mutex control_mutex_; // serializes start
+    std::vector<std::thread> threads_;
+    std::atomic<bool> stop_{false};
+    std::atomic<int> workers_{0};
+    std::atomic<int> depth_{kDefaultDepth};
+
+    std::mutex files_mutex_;
+    std::unordered_map<uint64_t, FileEntry> files_;
+    uint64_t next_epoch_ = 1;
+
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> coalesced_{0};
+    std::atomic<uint64_t> overflows_{0};
+    std::atomic<uint64_t> fetched_{0};
+    std::atomic<uint64_t> skipped_{0};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<uint64_t> fetched_bytes_{0};
+    std::atomic<uint64_t> fetch_us_{0};
+};
+
+extern "C" {
+    // Run workers native prefetch threads (0: stop). While running, the VFS
+    // queues its readahead here instead of calling prefetch callbacks.
+    void nfs_prefetch_start(int workers);
+    // READs each worker keeps in flight (default 8, at most 32)
+    void nfs_prefetch_set_depth(int depth);
+    void nfs_prefetch_get_stats(PrefetchStats* out);
+}
+
+#endif // PREFETCH_ENGINE_HPP
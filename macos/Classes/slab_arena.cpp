@@ -0,0 +1,48 @@
+#include "slab_arena.hpp"
+#include <sys/mman.h>
+
+SlabArena::~SlabArena() {
+    for (uint8_t* slab : slabs_) {
+        if (slab) munmap(slab, kSlotsPerSlab * slot_size_);
+    }
+}
+
+void SlabArena::reserve(size_t slots) {
+    if (slots <= committed_.size()) return;
+    committed_.resize(slots, false);
+    slabs_.resize((slots + kSlotsPerSlab - 1) / kSlotsPerSlab, nullptr);
+}
+
+uint8_t* SlabArena::slot(uint32_t index) {
+    if (index >= committed_.size()) return nullptr;
+    uint8_t*& slab = slabs_[index / kSlotsPerSlab];
+    if (!slab) {
+        void* p = mmap(nullptr, kSlotsPerSlab * slot_size_, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return nullptr;
+        slab = static_cast<uint8_t*>(p);
+    }
+    uint8_t* mem = slab + (index % kSlotsPerSlab) * slot_size_;
+    if (!committed_[index]) {
+#if defined(__APPLE__)
+        // Undo MADV_FREE_REUSABLE so the pages count against us again
+        madvise(mem, slot_size_, MADV_FREE_REUSE);
+#endif
+        committed_[index] = true;
+        committed_slots_++;
+    }
+    return mem;
+}
+
+size_t SlabArena::release(uint32_t index) {
+    if (index >= committed_.size() || !committed_[index]) return 0;
+    uint8_t* mem = slabs_[index / kSlotsPerSlab] + (index % kSlotsPerSlab) * slot_size_;
+#if defined(__APPLE__)
+    madvise(mem, slot_size_, MADV_FREE_REUSABLE);
+#else
+    madvise(mem, slot_size_, MADV_DONTNEED);
+#endif
+    committed_[index] = false;
+    committed_slots_--;
+    return slot_size_;
+}
@@ -0,0 +1,45 @@
+#ifndef SLAB_ARENA_HPP
+#define SLAB_ARENA_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Backing store for fixed-size cache slots. Slots are grouped into slabs that
+// are mapped on first use, and the OS only commits a page when it is first
+// written, so an idle cache costs address space, not memory. Slot memory
+// never moves while the arena lives, so pointers handed out stay valid.
+// Not thread safe: the owning shard serializes access.
+class SlabArena {
+public:
+    static constexpr size_t kSlotsPerSlab = 16;
+
+    explicit SlabArena(size_t slot_size) : slot_size_(slot_size) {}
+    ~SlabArena();
+
+    SlabArena(const SlabArena&) = delete;
+    SlabArena& operator=(const SlabArena&) = delete;
+
+    // Make room for slot indices [0, slots). Does not map anything.
+    void reserve(size_t slots);
+    size_t slot_count() const { return committed_.size(); }
+
+    // Memory of slot, mapping its slab if needed. nullptr if the mapping fails.
+    uint8_t* slot(uint32_t index);
+
+    // Return the slot's pages to the OS. The contents are undefined until the
+    // slot is written again. Returns the bytes released.
+    size_t release(uint32_t index);
+
+    // Bytes of slots written since they were last released (an upper bound on
+    // what the arena keeps resident)
+    size_t committed_bytes() const { return committed_slots_ * slot_size_; }
+
+private:
+    size_t slot_size_;
+    std::vector<uint8_t*> slabs_;
+    std::vector<bool> committed_;
+    size_t committed_slots_ = 0;
+};
+
+#endif // SLAB_ARENA_HPP